@@ -18,8 +18,13 @@
 
 #include "browser-app.hpp"
 #include "browser-version.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <mutex>
+#include <unordered_set>
 #include <nlohmann/json.hpp>
 
 #ifdef _WIN32
@@ -78,14 +83,17 @@ void BrowserApp::OnBeforeChildProcessLaunch(
 #else
 #endif
 
+	if (!shared_data_name.empty())
+		command_line->AppendSwitchWithValue(SHARED_DATA_SWITCH,
+						    shared_data_name);
+
+	/* One flag is queued for each browser created, in creation order,
+	 * and only renderer launches consume them */
+	if (command_line->GetSwitchValue("type") != "renderer")
+		return;
+
 	std::lock_guard<std::mutex> guard(flag_mutex);
-	if (this->media_flag != -1) {
-		if (this->media_flag) {
-			command_line->AppendSwitchWithValue(
-				"enable-media-stream", "1");
-		}
-		this->media_flag = -1;
-	} else if (this->media_flags.size()) {
+	if (this->media_flags.size()) {
 		bool flag = media_flags.front();
 		media_flags.pop();
 		if (flag) {
@@ -124,41 +132,214 @@ void BrowserApp::OnBeforeCommandLineProcessing(
 	command_line->AppendSwitchWithValue("autoplay-policy",
 					    "no-user-gesture-required");
 
-	std::lock_guard<std::mutex> guard(flag_mutex);
-	if (this->media_flag != -1) {
-		if (this->media_flag) {
-			command_line->AppendSwitchWithValue(
-				"enable-media-stream", "1");
-		}
-		this->media_flag = -1;
-	} else if (this->media_flags.size()) {
-		bool flag = media_flags.front();
-		media_flags.pop();
-		if (flag) {
-			command_line->AppendSwitchWithValue(
-				"enable-media-stream", "1");
-		}
-	}
 #ifdef __APPLE__
 	command_line->AppendSwitch("use-mock-keychain");
 #endif
 }
 
-std::vector<std::string> exposedFunctions = {
-	"getControlLevel",     "getCurrentScene",  "getStatus",
-	"startRecording",      "stopRecording",    "startStreaming",
-	"stopStreaming",       "pauseRecording",   "unpauseRecording",
-	"startReplayBuffer",   "stopReplayBuffer", "saveReplayBuffer",
-	"startVirtualcam",     "stopVirtualcam",   "getScenes",
-	"setCurrentScene",     "getTransitions",   "getCurrentTransition",
-	"setCurrentTransition"};
+std::unordered_set<std::string> exposedFunctions = {
+	"getControlLevel",      "getCurrentScene",  "getStatus",
+	"startRecording",       "stopRecording",    "startStreaming",
+	"stopStreaming",        "pauseRecording",   "unpauseRecording",
+	"startReplayBuffer",    "stopReplayBuffer", "saveReplayBuffer",
+	"startVirtualcam",      "stopVirtualcam",   "getScenes",
+	"setCurrentScene",      "getTransitions",   "getCurrentTransition",
+	"setCurrentTransition", "subscribe",        "getState"};
+
+/* Read functions that can be answered from a subscribed state topic.  Only
+ * topics that the browser process itself caches until a frontend event, see
+ * browser-state.cpp.  Status and the current scene can change without one,
+ * so those are always asked for. */
+static const std::unordered_map<std::string, std::string> cachedFunctions = {
+	{"getScenes", "scenes"},
+	{"getCurrentTransition", "currentTransition"},
+	{"getTransitions", "transitions"},
+};
+
+/* Frees the copy that an ArrayBuffer from obsstudio.sharedData wraps */
+class SharedDataReleaseCallback : public CefV8ArrayBufferReleaseCallback {
+public:
+	virtual void ReleaseBuffer(void *buffer) override { free(buffer); }
+
+	IMPLEMENT_REFCOUNTING(SharedDataReleaseCallback);
+};
+
+/* sharedData is a getter that returns a new copy on every read.  The
+ * mapping itself is read-only, and a page writing to it would crash the
+ * render process along with every other browser it hosts. */
+static const char *sharedDataScript =
+	"(function (obs, snapshot) {"
+	"  Object.defineProperty(obs, 'sharedData', {"
+	"    enumerable: true,"
+	"    get: function () { return snapshot(); }"
+	"  });"
+	"})";
+
+void BrowserApp::ExposeSharedData(CefRefPtr<CefV8Context> context,
+				  CefRefPtr<CefV8Value> obsStudioObj)
+{
+	if (!sharedDataOpened) {
+		sharedDataOpened = true;
+
+		std::string name =
+			CefCommandLine::GetGlobalCommandLine()
+				->GetSwitchValue(SHARED_DATA_SWITCH)
+				.ToString();
+		if (!name.empty())
+			sharedData.Open(name, sizeof(SharedData));
+	}
+
+	if (!sharedData.Get())
+		return;
+
+	CefRefPtr<CefV8Value> defineHook;
+	CefRefPtr<CefV8Exception> exception;
+
+	if (!context->Eval(sharedDataScript, "", 0, defineHook, exception))
+		return;
+
+	CefV8ValueList arguments;
+	arguments.push_back(obsStudioObj);
+	arguments.push_back(
+		CefV8Value::CreateFunction("sharedDataSnapshot", this));
+	defineHook->ExecuteFunction(nullptr, arguments);
+}
+
+/* Copies every record under its sequence, so the copy only holds records
+ * that were complete.  A record that keeps being rewritten while it is
+ * copied is left with an odd sequence. */
+static void CopySharedData(const SharedData *shared, uint8_t *copy)
+{
+	memcpy(copy, &shared->header, sizeof(SharedDataHeader));
+
+	for (size_t i = 0; i < SHARED_DATA_RECORDS; i++) {
+		const SharedDataRecord &record = shared->records[i];
+		uint8_t *out = copy + offsetof(SharedData, records) +
+			       i * sizeof(SharedDataRecord);
+		uint32_t sequence = 1;
+
+		for (int attempt = 0; attempt < 4; attempt++) {
+			sequence = record.sequence.load(
+				std::memory_order_acquire);
+			memcpy(out, &record, sizeof(SharedDataRecord));
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (!(sequence & 1) &&
+			    sequence == record.sequence.load(
+						std::memory_order_relaxed))
+				break;
+			sequence |= 1;
+		}
+
+		memcpy(out, &sequence, sizeof(sequence));
+	}
+}
+
+CefRefPtr<CefV8Value>
+BrowserApp::GetSharedDataSnapshot(CefRefPtr<CefBrowser> browser)
+{
+	/* The plugin only updates the block while a page reads it */
+	BrowserState &state = browserState[browser->GetIdentifier()];
+	if (!state.sharedDataRead) {
+		state.sharedDataRead = true;
+
+		CefRefPtr<CefProcessMessage> msg =
+			CefProcessMessage::Create("readSharedData");
+		msg->GetArgumentList()->SetBool(0, true);
+		SendBrowserProcessMessage(browser, PID_BROWSER, msg);
+	}
+
+	uint8_t *copy = (uint8_t *)malloc(sizeof(SharedData));
+	if (!copy)
+		return CefV8Value::CreateUndefined();
+
+	CopySharedData((const SharedData *)sharedData.Get(), copy);
+	return CefV8Value::CreateArrayBuffer(copy, sizeof(SharedData),
+					     new SharedDataReleaseCallback());
+}
+
+/* onVideoTick is a plain property for pages, but OBS only sends ticks
+ * while at least one frame of the browser has a handler set */
+static const char *videoTickScript =
+	"(function (obs, setEnabled) {"
+	"  var handler = null;"
+	"  Object.defineProperty(obs, 'onVideoTick', {"
+	"    enumerable: true,"
+	"    get: function () { return handler; },"
+	"    set: function (fn) {"
+	"      handler = typeof fn === 'function' ? fn : null;"
+	"      setEnabled(handler !== null);"
+	"    }"
+	"  });"
+	"})";
+
+void BrowserApp::ExposeVideoTick(CefRefPtr<CefV8Context> context,
+				 CefRefPtr<CefV8Value> obsStudioObj)
+{
+	CefRefPtr<CefV8Value> defineHook;
+	CefRefPtr<CefV8Exception> exception;
+
+	if (!context->Eval(videoTickScript, "", 0, defineHook, exception))
+		return;
+
+	CefV8ValueList arguments;
+	arguments.push_back(obsStudioObj);
+	arguments.push_back(
+		CefV8Value::CreateFunction("videoTickEnabled", this));
+	defineHook->ExecuteFunction(nullptr, arguments);
+}
+
+void BrowserApp::SetVideoTickEnabled(CefRefPtr<CefBrowser> browser,
+				     CefRefPtr<CefV8Context> context,
+				     bool enabled)
+{
+	auto state = browserState.find(browser->GetIdentifier());
+	if (state == browserState.end())
+		return;
+
+	auto &contexts = state->second.videoTickContexts;
+	bool wasEnabled = !contexts.empty();
+
+	auto it = std::find_if(contexts.begin(), contexts.end(),
+			       [&](CefRefPtr<CefV8Context> &c) {
+				       return c->IsSame(context);
+			       });
+	if (enabled && it == contexts.end())
+		contexts.push_back(context);
+	else if (!enabled && it != contexts.end())
+		contexts.erase(it);
+
+	if (wasEnabled == !contexts.empty())
+		return;
+
+	CefRefPtr<CefProcessMessage> msg =
+		CefProcessMessage::Create("setVideoTick");
+	msg->GetArgumentList()->SetBool(0, !contexts.empty());
+	SendBrowserProcessMessage(browser, PID_BROWSER, msg);
+}
 
 void BrowserApp::OnContextCreated(CefRefPtr<CefBrowser> browser,
-				  CefRefPtr<CefFrame>,
+				  CefRefPtr<CefFrame> frame,
 				  CefRefPtr<CefV8Context> context)
 {
+	/* A new page has to subscribe again */
+	if (frame->IsMain())
+		browserState[browser->GetIdentifier()].values.clear();
+
+	/* Before the page's own content, see ApplyCSS */
+	if (frame->IsMain())
+		ApplyCSS(browser, context);
+
 	CefRefPtr<CefV8Value> globalObj = context->GetGlobal();
 
+	/* Taken before any of the page's scripts run, so a page that replaces
+	 * JSON.parse doesn't change what its obsstudio calls resolve to */
+	CefRefPtr<CefV8Value> json = globalObj->GetValue("JSON");
+	CefRefPtr<CefV8Value> parse = json ? json->GetValue("parse") : nullptr;
+	if (parse && parse->IsFunction())
+		browserState[browser->GetIdentifier()].jsonParsers.push_back(
+			{context, json, parse});
+
 	CefRefPtr<CefV8Value> obsStudioObj =
 		CefV8Value::CreateObject(nullptr, nullptr);
 	globalObj->SetValue("obsstudio", obsStudioObj,
@@ -169,12 +350,25 @@ void BrowserApp::OnContextCreated(CefRefPtr<CefBrowser> browser,
 	obsStudioObj->SetValue("pluginVersion", pluginVersion,
 			       V8_PROPERTY_ATTRIBUTE_NONE);
 
-	for (std::string name : exposedFunctions) {
+	for (const std::string &name : exposedFunctions) {
 		CefRefPtr<CefV8Value> func =
 			CefV8Value::CreateFunction(name, this);
 		obsStudioObj->SetValue(name, func, V8_PROPERTY_ATTRIBUTE_NONE);
 	}
 
+	obsStudioObj->SetValue("getIpcStats",
+			       CefV8Value::CreateFunction("getIpcStats", this),
+			       V8_PROPERTY_ATTRIBUTE_NONE);
+
+	ExposeSharedData(context, obsStudioObj);
+	ExposeVideoTick(context, obsStudioObj);
+
+#if ENABLE_PAGE_AUDIO_STREAMS
+	obsStudioObj->SetValue("outputAudio",
+			       CefV8Value::CreateFunction("outputAudio", this),
+			       V8_PROPERTY_ATTRIBUTE_NONE);
+#endif
+
 #if !ENABLE_WASHIDDEN
 	int id = browser->GetIdentifier();
 	if (browserVis.find(id) != browserVis.end()) {
@@ -185,6 +379,21 @@ void BrowserApp::OnContextCreated(CefRefPtr<CefBrowser> browser,
 #endif
 }
 
+void BrowserApp::OnBrowserCreated(CefRefPtr<CefBrowser> browser,
+				  CefRefPtr<CefDictionaryValue> extra_info)
+{
+	/* Known before the first document is created, later changes come
+	 * in SetCSS messages */
+	if (extra_info && extra_info->HasKey("css"))
+		browserState[browser->GetIdentifier()].css =
+			extra_info->GetString("css").ToString();
+}
+
+void BrowserApp::OnBrowserDestroyed(CefRefPtr<CefBrowser> browser)
+{
+	browserState.erase(browser->GetIdentifier());
+}
+
 void BrowserApp::ExecuteJSFunction(CefRefPtr<CefBrowser> browser,
 				   const char *functionName,
 				   CefV8ValueList arguments)
@@ -296,54 +505,237 @@ void BrowserApp::SetDocumentVisibility(CefRefPtr<CefBrowser> browser,
 }
 #endif
 
-CefRefPtr<CefV8Value> CefValueToCefV8Value(CefRefPtr<CefValue> value)
-{
-	CefRefPtr<CefV8Value> result;
-	switch (value->GetType()) {
-	case VTYPE_INVALID:
-		result = CefV8Value::CreateNull();
-		break;
-	case VTYPE_NULL:
-		result = CefV8Value::CreateNull();
-		break;
-	case VTYPE_BOOL:
-		result = CefV8Value::CreateBool(value->GetBool());
-		break;
-	case VTYPE_INT:
-		result = CefV8Value::CreateInt(value->GetInt());
-		break;
-	case VTYPE_DOUBLE:
-		result = CefV8Value::CreateDouble(value->GetDouble());
-		break;
-	case VTYPE_STRING:
-		result = CefV8Value::CreateString(value->GetString());
-		break;
-	case VTYPE_BINARY:
-		result = CefV8Value::CreateNull();
-		break;
-	case VTYPE_DICTIONARY: {
-		result = CefV8Value::CreateObject(nullptr, nullptr);
-		CefRefPtr<CefDictionaryValue> dict = value->GetDictionary();
-		CefDictionaryValue::KeyList keys;
-		dict->GetKeys(keys);
-		for (unsigned int i = 0; i < keys.size(); i++) {
-			CefString key = keys[i];
-			result->SetValue(
-				key, CefValueToCefV8Value(dict->GetValue(key)),
-				V8_PROPERTY_ATTRIBUTE_NONE);
+/* Lets V8 build the value straight from the JSON text of a reply, with the
+ * JSON.parse that the context started out with.  The context has to be
+ * entered. */
+CefRefPtr<CefV8Value> BrowserApp::ParseJSON(const BrowserState &state,
+					    CefRefPtr<CefV8Context> context,
+					    const std::string &json)
+{
+	for (const JSONParser &parser : state.jsonParsers) {
+		if (!parser.context->IsSame(context))
+			continue;
+
+		CefV8ValueList arguments;
+		arguments.push_back(CefV8Value::CreateString(json));
+		CefRefPtr<CefV8Value> value =
+			parser.parse->ExecuteFunction(parser.json, arguments);
+		return value ? value : CefV8Value::CreateNull();
+	}
+
+	return CefV8Value::CreateNull();
+}
+
+#define CALLBACK_INDEX_BITS 20
+#define CALLBACK_INDEX_MASK ((1u << CALLBACK_INDEX_BITS) - 1)
+#define CALLBACK_GENERATION_MAX 0x7ffu
+
+int BrowserApp::AddCallback(CefRefPtr<CefV8Context> context,
+			    CefRefPtr<CefV8Value> callback,
+			    CefRefPtr<CefV8Value> promise)
+{
+	uint32_t index;
+
+	if (!freeCallbackSlots.empty()) {
+		index = freeCallbackSlots.back();
+		freeCallbackSlots.pop_back();
+	} else if (callbackSlots.size() <= CALLBACK_INDEX_MASK) {
+		index = (uint32_t)callbackSlots.size();
+		callbackSlots.emplace_back();
+	} else {
+		return 0;
+	}
+
+	CallbackSlot &slot = callbackSlots[index];
+	slot.context = context;
+	slot.callback = callback;
+	slot.promise = promise;
+	slot.sent = std::chrono::steady_clock::now();
+
+	/* Generations start at 1, so 0 is never a valid id */
+	return (int)((slot.generation << CALLBACK_INDEX_BITS) | index);
+}
+
+void BrowserApp::ReleaseCallback(uint32_t index)
+{
+	CallbackSlot &slot = callbackSlots[index];
+	slot.context = nullptr;
+	slot.callback = nullptr;
+	slot.promise = nullptr;
+	slot.generation = slot.generation % CALLBACK_GENERATION_MAX + 1;
+
+	freeCallbackSlots.push_back(index);
+}
+
+bool BrowserApp::TakeCallback(int id, CallbackSlot &slot)
+{
+	uint32_t index = (uint32_t)id & CALLBACK_INDEX_MASK;
+	uint32_t generation = (uint32_t)id >> CALLBACK_INDEX_BITS;
+
+	if (index >= callbackSlots.size())
+		return false;
+	if (callbackSlots[index].generation != generation ||
+	    !callbackSlots[index].context)
+		return false;
+
+	slot = callbackSlots[index];
+	ReleaseCallback(index);
+	return true;
+}
+
+void BrowserApp::OnContextReleased(CefRefPtr<CefBrowser> browser,
+				   CefRefPtr<CefFrame> frame,
+				   CefRefPtr<CefV8Context> context)
+{
+	SetVideoTickEnabled(browser, context, false);
+
+	auto state = browserState.find(browser->GetIdentifier());
+	if (state != browserState.end() && frame->IsMain() &&
+	    state->second.sharedDataRead) {
+		state->second.sharedDataRead = false;
+
+		CefRefPtr<CefProcessMessage> msg =
+			CefProcessMessage::Create("readSharedData");
+		msg->GetArgumentList()->SetBool(0, false);
+		SendBrowserProcessMessage(browser, PID_BROWSER, msg);
+	}
+
+	if (state != browserState.end()) {
+		auto &parsers = state->second.jsonParsers;
+		parsers.erase(std::remove_if(parsers.begin(), parsers.end(),
+					     [&](const JSONParser &parser) {
+						     return parser.context
+							     ->IsSame(context);
+					     }),
+			      parsers.end());
+	}
+
+	if (state != browserState.end() && state->second.cssContext &&
+	    state->second.cssContext->IsSame(context)) {
+		state->second.cssContext = nullptr;
+		state->second.cssSheet = nullptr;
+	}
+
+	/* Calls made from this context can no longer be answered */
+	for (uint32_t i = 0; i < callbackSlots.size(); i++) {
+		CefRefPtr<CefV8Context> &slotContext = callbackSlots[i].context;
+		if (slotContext && slotContext->IsSame(context))
+			ReleaseCallback(i);
+	}
+}
+
+/* The custom CSS is kept in a constructed stylesheet adopted by the main
+ * frame's document.  It is adopted as soon as the document's context
+ * exists, so the page is laid out with it from the first frame, and a CSS
+ * change only replaces the sheet's rules, so the page keeps its state
+ * instead of being reloaded. */
+void BrowserApp::ApplyCSS(CefRefPtr<CefBrowser> browser,
+			  CefRefPtr<CefV8Context> context)
+{
+	BrowserState &state = browserState[browser->GetIdentifier()];
+	if (!context || !context->Enter())
+		return;
+
+	if (!state.cssContext || !state.cssContext->IsSame(context)) {
+		state.cssContext = nullptr;
+		state.cssSheet = nullptr;
+
+		CefRefPtr<CefV8Value> sheet;
+		CefRefPtr<CefV8Exception> exception;
+		if (!state.css.empty() &&
+		    context->Eval("new CSSStyleSheet()", "", 0, sheet,
+				  exception) &&
+		    sheet && sheet->IsObject()) {
+			state.cssContext = context;
+			state.cssSheet = sheet;
+		}
+	}
+
+	if (state.cssSheet) {
+		CefV8ValueList args;
+		args.push_back(CefV8Value::CreateString(state.css));
+		state.cssSheet->GetValue("replaceSync")
+			->ExecuteFunction(state.cssSheet, args);
+
+		/* Adopt it again if the page replaced the adopted sheets */
+		CefRefPtr<CefV8Value> document =
+			context->GetGlobal()->GetValue("document");
+		CefRefPtr<CefV8Value> adopted =
+			document->GetValue("adoptedStyleSheets");
+		int count = adopted && adopted->IsArray()
+				    ? adopted->GetArrayLength()
+				    : 0;
+		bool found = false;
+
+		for (int i = 0; i < count && !found; i++)
+			found = adopted->GetValue(i)->IsSame(state.cssSheet);
+
+		if (!found) {
+			CefRefPtr<CefV8Value> sheets =
+				CefV8Value::CreateArray(count + 1);
+			for (int i = 0; i < count; i++)
+				sheets->SetValue(i, adopted->GetValue(i));
+			sheets->SetValue(count, state.cssSheet);
+
+			document->SetValue("adoptedStyleSheets", sheets,
+					   V8_PROPERTY_ATTRIBUTE_NONE);
 		}
-	} break;
-	case VTYPE_LIST: {
-		CefRefPtr<CefListValue> list = value->GetList();
-		size_t size = list->GetSize();
-		result = CefV8Value::CreateArray((int)size);
-		for (size_t i = 0; i < size; i++) {
-			result->SetValue((int)i, CefValueToCefV8Value(
-							 list->GetValue(i)));
+	}
+
+	context->Exit();
+}
+
+static std::string CustomEventScript(CefRefPtr<CefListValue> args, size_t idx,
+				     bool hasDetail)
+{
+	nlohmann::json wrapperJson;
+	if (hasDetail)
+		wrapperJson["detail"] = nlohmann::json::parse(
+			args->GetString(idx + 1).ToString(), nullptr, false);
+	std::string wrapperJsonString = wrapperJson.dump();
+	std::string script;
+
+	script += "new CustomEvent('";
+	script += args->GetString(idx).ToString();
+	script += "', ";
+	script += wrapperJsonString;
+	script += ");";
+	return script;
+}
+
+/* Enters each frame's context once and dispatches the events in order */
+static void DispatchCustomEvents(CefRefPtr<CefBrowser> browser,
+				 const std::vector<std::string> &scripts)
+{
+	std::vector<CefString> names;
+	browser->GetFrameNames(names);
+	for (auto &name : names) {
+		CefRefPtr<CefFrame> frame = browser->GetFrame(name);
+		CefRefPtr<CefV8Context> context = frame->GetV8Context();
+
+		context->Enter();
+
+		CefRefPtr<CefV8Value> globalObj = context->GetGlobal();
+		CefRefPtr<CefV8Value> dispatchEvent =
+			globalObj->GetValue("dispatchEvent");
+
+		for (auto &script : scripts) {
+			CefRefPtr<CefV8Value> returnValue;
+			CefRefPtr<CefV8Exception> exception;
+
+			/* Create the CustomEvent object
+			* We have to use eval to invoke the new operator */
+			context->Eval(script, browser->GetMainFrame()->GetURL(),
+				      0, returnValue, exception);
+
+			CefV8ValueList arguments;
+			arguments.push_back(returnValue);
+
+			dispatchEvent->ExecuteFunction(nullptr, arguments);
 		}
-	} break;
+
+		context->Exit();
 	}
-	return result;
 }
 
 bool BrowserApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
@@ -373,105 +765,325 @@ bool BrowserApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 		ExecuteJSFunction(browser, "onActiveChange", arguments);
 
 	} else if (message->GetName() == "DispatchJSEvent") {
-		nlohmann::json payloadJson = nlohmann::json::parse(
-			args->GetString(1).ToString(), nullptr, false);
+		std::vector<std::string> scripts;
+		scripts.push_back(CustomEventScript(args, 0, args->GetSize() > 1));
 
-		nlohmann::json wrapperJson;
-		if (args->GetSize() > 1)
-			wrapperJson["detail"] = payloadJson;
-		std::string wrapperJsonString = wrapperJson.dump();
-		std::string script;
+		DispatchCustomEvents(browser, scripts);
 
-		script += "new CustomEvent('";
-		script += args->GetString(0).ToString();
-		script += "', ";
-		script += wrapperJsonString;
-		script += ");";
+	} else if (message->GetName() == "DispatchJSEvents") {
+		std::vector<std::string> scripts;
+		for (size_t i = 0; i + 1 < args->GetSize(); i += 2)
+			scripts.push_back(CustomEventScript(args, i, true));
 
-		std::vector<CefString> names;
-		browser->GetFrameNames(names);
-		for (auto &name : names) {
-			CefRefPtr<CefFrame> frame = browser->GetFrame(name);
-			CefRefPtr<CefV8Context> context = frame->GetV8Context();
+		DispatchCustomEvents(browser, scripts);
 
-			context->Enter();
+	} else if (message->GetName() == "VideoTick") {
+		CefV8ValueList arguments;
+		arguments.push_back(CefV8Value::CreateDouble(args->GetDouble(0)));
+		arguments.push_back(CefV8Value::CreateDouble(args->GetDouble(1)));
 
-			CefRefPtr<CefV8Value> globalObj = context->GetGlobal();
+		ExecuteJSFunction(browser, "onVideoTick", arguments);
 
-			CefRefPtr<CefV8Value> returnValue;
-			CefRefPtr<CefV8Exception> exception;
+	} else if (message->GetName() == "SetCSS") {
+		BrowserState &state = browserState[browser->GetIdentifier()];
+		state.css = args->GetString(0).ToString();
 
-			/* Create the CustomEvent object
-			* We have to use eval to invoke the new operator */
-			context->Eval(script, browser->GetMainFrame()->GetURL(),
-				      0, returnValue, exception);
+		ApplyCSS(browser, browser->GetMainFrame()->GetV8Context());
 
-			CefV8ValueList arguments;
-			arguments.push_back(returnValue);
+	} else if (message->GetName() == "StateUpdate") {
+		BrowserState &state = browserState[browser->GetIdentifier()];
+		std::vector<std::string> scripts;
 
-			CefRefPtr<CefV8Value> dispatchEvent =
-				globalObj->GetValue("dispatchEvent");
-			dispatchEvent->ExecuteFunction(nullptr, arguments);
+		state.stateUpdates++;
+
+		for (size_t i = 0; i + 1 < args->GetSize(); i += 2) {
+			std::string topic = args->GetString(i).ToString();
+			std::string value = args->GetString(i + 1).ToString();
 
-			context->Exit();
+			nlohmann::json parsed =
+				nlohmann::json::parse(value, nullptr, false);
+			nlohmann::json detail = {{"topic", topic},
+						 {"value", parsed}};
+			nlohmann::json wrapperJson = {{"detail", detail}};
+
+			scripts.push_back("new CustomEvent('obsStateChanged', " +
+					  wrapperJson.dump() + ");");
+			state.values[topic] = std::move(value);
 		}
 
-	} else if (message->GetName() == "executeCallback") {
-		CefRefPtr<CefV8Context> context =
-			browser->GetMainFrame()->GetV8Context();
+		DispatchCustomEvents(browser, scripts);
+
+	} else if (message->GetName() == "StateRevoke") {
+		BrowserState &state = browserState[browser->GetIdentifier()];
+		for (size_t i = 0; i < args->GetSize(); i++)
+			state.values.erase(args->GetString(i).ToString());
 
+	} else if (message->GetName() == "executeCallback") {
+		CallbackSlot slot;
+		if (!TakeCallback(args->GetInt(0), slot))
+			return true;
+
+		BrowserState &state = browserState[browser->GetIdentifier()];
+		uint64_t latencyUs =
+			std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - slot.sent)
+				.count();
+		state.roundTrips++;
+		state.latencyTotalUs += latencyUs;
+		if (latencyUs > state.latencyMaxUs)
+			state.latencyMaxUs = latencyUs;
+
+		CefRefPtr<CefV8Context> context = slot.context;
 		context->Enter();
 
-		CefRefPtr<CefListValue> arguments = message->GetArgumentList();
-		int callbackID = arguments->GetInt(0);
-		CefString jsonString = arguments->GetString(1);
+		std::string json = args->GetString(1).ToString();
+		CefRefPtr<CefV8Value> value = ParseJSON(state, context, json);
 
-		CefRefPtr<CefValue> json =
-			CefParseJSON(arguments->GetString(1).ToString(), {});
+		if (slot.callback) {
+			CefV8ValueList arguments;
+			arguments.push_back(value);
+			slot.callback->ExecuteFunction(nullptr, arguments);
+		}
+		if (slot.promise)
+			slot.promise->ResolvePromise(value);
 
-		CefRefPtr<CefV8Value> callback = callbackMap[callbackID];
-		CefV8ValueList args;
+		context->Exit();
 
-		CefRefPtr<CefV8Value> retval = CefValueToCefV8Value(json);
+	} else {
+		return false;
+	}
 
-		args.push_back(retval);
+	return true;
+}
 
-		if (callback)
-			callback->ExecuteFunction(nullptr, args);
+/* Only scalar array elements are passed on */
+static CefRefPtr<CefListValue> V8ArrayToList(CefRefPtr<CefV8Value> array)
+{
+	CefRefPtr<CefListValue> list = CefListValue::Create();
+	int length = array->GetArrayLength();
+
+	for (int i = 0; i < length; i++) {
+		CefRefPtr<CefV8Value> value = array->GetValue(i);
+		size_t idx = list->GetSize();
+
+		if (value->IsString())
+			list->SetString(idx, value->GetStringValue());
+		else if (value->IsInt())
+			list->SetInt(idx, value->GetIntValue());
+		else if (value->IsBool())
+			list->SetBool(idx, value->GetBoolValue());
+		else if (value->IsDouble())
+			list->SetDouble(idx, value->GetDoubleValue());
+	}
 
-		context->Exit();
+	return list;
+}
 
-		callbackMap.erase(callbackID);
+bool IsValidFunction(const std::string &function)
+{
+	return exposedFunctions.count(function) != 0;
+}
 
-	} else {
+CefRefPtr<CefV8Value> BrowserApp::GetIpcStats(CefRefPtr<CefBrowser> browser)
+{
+	BrowserState &state = browserState[browser->GetIdentifier()];
+
+	CefRefPtr<CefV8Value> stats =
+		CefV8Value::CreateObject(nullptr, nullptr);
+	stats->SetValue("requests",
+			CefV8Value::CreateDouble((double)state.ipcRequests),
+			V8_PROPERTY_ATTRIBUTE_NONE);
+	stats->SetValue("avoided",
+			CefV8Value::CreateDouble((double)state.ipcAvoided),
+			V8_PROPERTY_ATTRIBUTE_NONE);
+	stats->SetValue("stateUpdates",
+			CefV8Value::CreateDouble((double)state.stateUpdates),
+			V8_PROPERTY_ATTRIBUTE_NONE);
+	stats->SetValue("roundTrips",
+			CefV8Value::CreateDouble((double)state.roundTrips),
+			V8_PROPERTY_ATTRIBUTE_NONE);
+
+	double avgLatencyMs = state.roundTrips
+				      ? (double)state.latencyTotalUs /
+						(double)state.roundTrips / 1000.0
+				      : 0.0;
+	stats->SetValue("avgLatencyMs", CefV8Value::CreateDouble(avgLatencyMs),
+			V8_PROPERTY_ATTRIBUTE_NONE);
+	stats->SetValue("maxLatencyMs",
+			CefV8Value::CreateDouble((double)state.latencyMaxUs /
+						 1000.0),
+			V8_PROPERTY_ATTRIBUTE_NONE);
+	return stats;
+}
+
+bool BrowserApp::ExecuteCached(CefRefPtr<CefBrowser> browser,
+			       const std::string &name,
+			       const CefV8ValueList &arguments,
+			       CefRefPtr<CefV8Value> &retval)
+{
+	auto function = cachedFunctions.find(name);
+	if (function == cachedFunctions.end())
 		return false;
-	}
 
+	BrowserState &state = browserState[browser->GetIdentifier()];
+	auto cached = state.values.find(function->second);
+	if (cached == state.values.end())
+		return false;
+
+	state.ipcAvoided++;
+
+	CefRefPtr<CefV8Context> context = CefV8Context::GetCurrentContext();
+	CefRefPtr<CefV8Value> value = ParseJSON(state, context, cached->second);
+
+#if CHROME_VERSION_BUILD >= 4638
+	retval = CefV8Value::CreatePromise();
+	retval->ResolvePromise(value);
+#else
+	UNUSED_PARAMETER(retval);
+#endif
+
+	if (arguments.empty() || !arguments[0]->IsFunction())
+		return true;
+
+	/* Still call back asynchronously, like a reply from the browser
+	 * process would */
+	CefRefPtr<CefV8Value> callback = arguments[0];
+
+	CefV8ValueList bindArgs;
+	bindArgs.push_back(CefV8Value::CreateNull());
+	bindArgs.push_back(value);
+	CefRefPtr<CefV8Value> bound =
+		callback->GetValue("bind")->ExecuteFunction(callback, bindArgs);
+
+	CefRefPtr<CefV8Value> queueMicrotask =
+		context->GetGlobal()->GetValue("queueMicrotask");
+
+	CefV8ValueList queueArgs;
+	queueArgs.push_back(bound);
+	queueMicrotask->ExecuteFunction(nullptr, queueArgs);
 	return true;
 }
 
-bool IsValidFunction(std::string function)
+#if ENABLE_PAGE_AUDIO_STREAMS
+/* obsstudio.outputAudio(stream, sampleRate, [ArrayBuffer, ...]), one
+ * buffer of 32-bit float samples per channel, each copied into the message
+ * as a CefBinaryValue */
+static void OutputAudio(CefRefPtr<CefBrowser> browser,
+			const CefV8ValueList &arguments, CefString &exception)
 {
-	std::vector<std::string>::iterator iterator;
-	iterator = std::find(exposedFunctions.begin(), exposedFunctions.end(),
-			     function);
-	return iterator != exposedFunctions.end();
+	if (arguments.size() < 3 || !arguments[0]->IsString() ||
+	    !arguments[1]->IsDouble() || !arguments[2]->IsArray()) {
+		exception = "outputAudio expects a stream name, a sample rate "
+			    "and an array of ArrayBuffers";
+		return;
+	}
+
+	CefRefPtr<CefV8Value> channels = arguments[2];
+	int channel_count = channels->GetArrayLength();
+	if (channel_count < 1 || channel_count > 8) {
+		exception = "outputAudio supports 1 to 8 channels";
+		return;
+	}
+
+	CefRefPtr<CefProcessMessage> msg =
+		CefProcessMessage::Create("OutputAudio");
+	CefRefPtr<CefListValue> args = msg->GetArgumentList();
+	args->SetString(0, arguments[0]->GetStringValue());
+	args->SetInt(1, (int)arguments[1]->GetDoubleValue());
+
+	/* When the page sent it, so that the browser process can tell how
+	 * long delivery took.  The steady clock is shared by all processes. */
+	auto sent = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch());
+	args->SetDouble(2, (double)sent.count());
+
+	size_t size = 0;
+	for (int i = 0; i < channel_count; i++) {
+		CefRefPtr<CefV8Value> buffer = channels->GetValue(i);
+		if (!buffer->IsArrayBuffer()) {
+			exception = "outputAudio channels must be ArrayBuffers";
+			return;
+		}
+
+		size_t length = buffer->GetArrayBufferByteLength();
+		if (i == 0)
+			size = length;
+		if (length != size || !length || length % sizeof(float)) {
+			exception = "outputAudio channels must have the same "
+				    "number of samples";
+			return;
+		}
+
+		args->SetBinary(3 + i,
+				CefBinaryValue::Create(
+					buffer->GetArrayBufferData(), length));
+	}
+
+	SendBrowserProcessMessage(browser, PID_BROWSER, msg);
 }
+#endif
 
 bool BrowserApp::Execute(const CefString &name, CefRefPtr<CefV8Value>,
 			 const CefV8ValueList &arguments,
-			 CefRefPtr<CefV8Value> &, CefString &)
+			 CefRefPtr<CefV8Value> &retval, CefString &exception)
 {
-	if (IsValidFunction(name.ToString())) {
-		if (arguments.size() >= 1 && arguments[0]->IsFunction()) {
-			callbackId++;
-			callbackMap[callbackId] = arguments[0];
+#if !ENABLE_PAGE_AUDIO_STREAMS
+	UNUSED_PARAMETER(exception);
+#endif
+	CefRefPtr<CefBrowser> browser =
+		CefV8Context::GetCurrentContext()->GetBrowser();
+
+	if (name == "getIpcStats") {
+		retval = GetIpcStats(browser);
+
+	} else if (name == "sharedDataSnapshot") {
+		retval = GetSharedDataSnapshot(browser);
+
+	} else if (name == "videoTickEnabled") {
+		SetVideoTickEnabled(browser, CefV8Context::GetCurrentContext(),
+				    !arguments.empty() &&
+					    arguments[0]->GetBoolValue());
+
+#if ENABLE_PAGE_AUDIO_STREAMS
+	} else if (name == "outputAudio") {
+		OutputAudio(browser, arguments, exception);
+
+#endif
+	} else if (ExecuteCached(browser, name.ToString(), arguments, retval)) {
+		return true;
+
+	} else if (IsValidFunction(name.ToString())) {
+		browserState[browser->GetIdentifier()].ipcRequests++;
+
+		CefRefPtr<CefV8Value> callback;
+		if (arguments.size() >= 1 && arguments[0]->IsFunction())
+			callback = arguments[0];
+
+		CefRefPtr<CefV8Value> promise;
+#if CHROME_VERSION_BUILD >= 4638
+		promise = CefV8Value::CreatePromise();
+		retval = promise;
+#endif
+
+		int id = 0;
+		if (callback || promise) {
+			id = AddCallback(CefV8Context::GetCurrentContext(),
+					 callback, promise);
+
+			/* Every callback slot is waiting for a reply */
+			if (!id) {
+#if CHROME_VERSION_BUILD >= 4638
+				promise->RejectPromise(
+					"Too many pending obsstudio calls");
+#endif
+				return true;
+			}
 		}
 
 		CefRefPtr<CefProcessMessage> msg =
 			CefProcessMessage::Create(name);
 		CefRefPtr<CefListValue> args = msg->GetArgumentList();
-		args->SetInt(0, callbackId);
+		args->SetInt(0, id);
 
 		/* Pass on arguments */
 		for (u_long l = 0; l < arguments.size(); l++) {
@@ -492,10 +1104,10 @@ bool BrowserApp::Execute(const CefString &name, CefRefPtr<CefV8Value>,
 			else if (arguments[l]->IsDouble())
 				args->SetDouble(pos,
 						arguments[l]->GetDoubleValue());
+			else if (arguments[l]->IsArray())
+				args->SetList(pos, V8ArrayToList(arguments[l]));
 		}
 
-		CefRefPtr<CefBrowser> browser =
-			CefV8Context::GetCurrentContext()->GetBrowser();
 		SendBrowserProcessMessage(browser, PID_BROWSER, msg);
 
 	} else {
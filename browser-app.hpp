@@ -18,11 +18,14 @@
 
 #pragma once
 
-#include <map>
+#include <chrono>
+#include <string>
+#include <vector>
 #include <queue>
 #include <unordered_map>
 #include <functional>
 #include "cef-headers.hpp"
+#include "browser-shared-data.hpp"
 #include <mutex>
 
 typedef std::function<void(CefRefPtr<CefBrowser>)> BrowserFunc;
@@ -73,21 +76,101 @@ class BrowserApp : public CefApp,
 			       const char *functionName,
 			       CefV8ValueList arguments);
 
-	typedef std::map<int, CefRefPtr<CefV8Value>> CallbackMap;
+	/* Pending obsstudio calls.  A call id carries the generation of its
+	 * slot, so a reply that arrives after the slot was released (e.g. its
+	 * context went away) is ignored instead of resolving a newer call that
+	 * reused the slot. */
+	struct CallbackSlot {
+		uint32_t generation = 1;
+		CefRefPtr<CefV8Context> context;
+		CefRefPtr<CefV8Value> callback;
+		CefRefPtr<CefV8Value> promise;
+		std::chrono::steady_clock::time_point sent;
+	};
 
 	bool shared_texture_available;
-	CallbackMap callbackMap;
-	int callbackId;
+	std::vector<CallbackSlot> callbackSlots;
+	std::vector<uint32_t> freeCallbackSlots;
+
+	int AddCallback(CefRefPtr<CefV8Context> context,
+			CefRefPtr<CefV8Value> callback,
+			CefRefPtr<CefV8Value> promise);
+	bool TakeCallback(int id, CallbackSlot &slot);
+	void ReleaseCallback(uint32_t index);
+
+	/* The JSON object and JSON.parse of a context, as they were when the
+	 * context was created */
+	struct JSONParser {
+		CefRefPtr<CefV8Context> context;
+		CefRefPtr<CefV8Value> json;
+		CefRefPtr<CefV8Value> parse;
+	};
+
+	/* Values pushed for the state topics a page subscribed to, which
+	 * are used to answer the matching get* calls without a round trip
+	 * to the browser process */
+	struct BrowserState {
+		std::unordered_map<std::string, std::string> values;
+		uint64_t ipcRequests = 0;
+		uint64_t ipcAvoided = 0;
+		uint64_t stateUpdates = 0;
+		uint64_t roundTrips = 0;
+		uint64_t latencyTotalUs = 0;
+		uint64_t latencyMaxUs = 0;
+
+		/* Whether the page read obsstudio.sharedData, which keeps the
+		 * plugin updating it */
+		bool sharedDataRead = false;
+
+		/* Replies are parsed by V8 in the context of the call */
+		std::vector<JSONParser> jsonParsers;
+
+		/* Contexts that have set obsstudio.onVideoTick */
+		std::vector<CefRefPtr<CefV8Context>> videoTickContexts;
+
+		/* The source's custom CSS, and the stylesheet that the main
+		 * frame's document adopted for it */
+		std::string css;
+		CefRefPtr<CefV8Context> cssContext;
+		CefRefPtr<CefV8Value> cssSheet;
+	};
+
+	std::unordered_map<int, BrowserState> browserState;
+
+	static CefRefPtr<CefV8Value> ParseJSON(const BrowserState &state,
+					       CefRefPtr<CefV8Context> context,
+					       const std::string &json);
+
+	/* Render process mapping of the plugin's shared data block */
+	SharedMemory sharedData;
+	bool sharedDataOpened = false;
+
+	void ExposeSharedData(CefRefPtr<CefV8Context> context,
+			      CefRefPtr<CefV8Value> obsStudioObj);
+	CefRefPtr<CefV8Value>
+	GetSharedDataSnapshot(CefRefPtr<CefBrowser> browser);
+	void ExposeVideoTick(CefRefPtr<CefV8Context> context,
+			     CefRefPtr<CefV8Value> obsStudioObj);
+	void SetVideoTickEnabled(CefRefPtr<CefBrowser> browser,
+				 CefRefPtr<CefV8Context> context,
+				 bool enabled);
+
+	bool ExecuteCached(CefRefPtr<CefBrowser> browser,
+			   const std::string &name,
+			   const CefV8ValueList &arguments,
+			   CefRefPtr<CefV8Value> &retval);
+	CefRefPtr<CefV8Value> GetIpcStats(CefRefPtr<CefBrowser> browser);
+	void ApplyCSS(CefRefPtr<CefBrowser> browser,
+		      CefRefPtr<CefV8Context> context);
 
 public:
 	inline BrowserApp(bool shared_texture_available_ = false)
-		: shared_texture_available(shared_texture_available_),
-		  media_flag(-1)
+		: shared_texture_available(shared_texture_available_)
 	{
 	}
 
 	void AddFlag(bool flag);
-	int media_flag;
+	std::string shared_data_name;
 	std::mutex flag_mutex;
 	std::queue<bool> media_flags;
 	virtual CefRefPtr<CefRenderProcessHandler>
@@ -104,6 +187,13 @@ public:
 	virtual void OnContextCreated(CefRefPtr<CefBrowser> browser,
 				      CefRefPtr<CefFrame> frame,
 				      CefRefPtr<CefV8Context> context) override;
+	virtual void
+	OnBrowserCreated(CefRefPtr<CefBrowser> browser,
+			 CefRefPtr<CefDictionaryValue> extra_info) override;
+	virtual void OnBrowserDestroyed(CefRefPtr<CefBrowser> browser) override;
+	virtual void OnContextReleased(CefRefPtr<CefBrowser> browser,
+				       CefRefPtr<CefFrame> frame,
+				       CefRefPtr<CefV8Context> context) override;
 	virtual bool
 	OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 				 CefRefPtr<CefFrame> frame,
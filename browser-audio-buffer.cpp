@@ -0,0 +1,381 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "browser-audio-buffer.hpp"
+
+#include <util/platform.h>
+#include <util/sse-intrin.h>
+#include <util/util_uint64.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/* Held audio goes out with the timestamps it came with, so libobs has to
+ * buffer the whole mix by as much as is held back here.  libobs gives up
+ * at MAX_BUFFERING_TICKS (45 ticks, about 960 ms at 48 kHz) and never
+ * lowers its buffering again, so the depth is capped at a tenth of that.
+ * With the largest packet on top, at most about 120 ms are held. */
+#define MIN_DEPTH_NS 10000000ULL  /* 10 ms */
+#define MAX_DEPTH_NS 100000000ULL /* 100 ms */
+#define JITTER_DEPTH_FACTOR 4.0
+#define MAX_SLEW 0.01 /* of each packet's duration */
+#define SILENCE_THRESHOLD 0.00001f /* -100 dBFS */
+#define FADE_MS 10
+
+uint64_t AudioJitterBuffer::FramesToNs(size_t frames) const
+{
+	return util_mul_div64(frames, 1000000000ULL, sample_rate);
+}
+
+size_t AudioJitterBuffer::NsToFrames(uint64_t ns) const
+{
+	return (size_t)util_mul_div64(ns, sample_rate, 1000000000ULL);
+}
+
+size_t AudioJitterBuffer::FadeFrames() const
+{
+	return (size_t)sample_rate * FADE_MS / 1000;
+}
+
+uint64_t AudioJitterBuffer::Depth() const
+{
+	uint64_t depth = (uint64_t)(jitter_ns * JITTER_DEPTH_FACTOR);
+	return std::clamp<uint64_t>(depth, MIN_DEPTH_NS, MAX_DEPTH_NS);
+}
+
+void AudioJitterBuffer::UpdateJitter(uint64_t arrival, uint64_t ts)
+{
+	/* Interarrival jitter as in RFC 3550: how much the spacing of packet
+	 * arrivals differs from the spacing of their timestamps */
+	if (have_last) {
+		double d = (double)(int64_t)(arrival - last_arrival) -
+			   (double)(int64_t)(ts - last_ts);
+		jitter_ns += (fabs(d) - jitter_ns) / 16.0;
+	}
+
+	have_last = true;
+	last_arrival = arrival;
+	last_ts = ts;
+
+	stat_jitter_ms = jitter_ns / 1000000.0;
+	stat_depth_ms = (uint32_t)(Depth() / 1000000ULL);
+}
+
+void AudioJitterBuffer::UpdateLatency(uint64_t ts)
+{
+	uint64_t now = os_gettime_ns();
+	if (now < ts)
+		return;
+
+	double latency = (double)(now - ts);
+	latency_ns += (latency - latency_ns) / 16.0;
+
+	stat_buffer_latency_ms = latency_ns / 1000000.0;
+	if (latency / 1000000.0 > stat_max_buffer_latency_ms)
+		stat_max_buffer_latency_ms = latency / 1000000.0;
+}
+
+/* Moves the timeline towards the incoming timestamps by a small part of
+ * each packet's duration, so clock drift is followed without the jumps that
+ * make libobs reset its own timeline.  Jitter averages out in the smoothed
+ * drift and barely moves it. */
+void AudioJitterBuffer::Slew(int64_t drift, size_t frames)
+{
+	drift_ns += ((double)drift - drift_ns) / 16.0;
+
+	double limit = (double)FramesToNs(frames) * MAX_SLEW;
+	double step = std::clamp(drift_ns, -limit, limit);
+
+	next_ts += (uint64_t)(int64_t)step;
+	drift_ns -= step;
+}
+
+void AudioJitterBuffer::Reserve(size_t frames)
+{
+	if (buffered + frames <= capacity)
+		return;
+
+	size_t new_capacity = capacity ? capacity : AUDIO_OUTPUT_FRAMES;
+	while (new_capacity < buffered + frames)
+		new_capacity *= 2;
+
+	/* Unwrapped into the new planes, which is rare enough that the copy
+	 * doesn't matter */
+	for (size_t i = 0; i < channels; i++) {
+		std::vector<float> plane(new_capacity);
+		for (size_t j = 0; j < buffered; j++)
+			plane[j] = ring[i][(read_pos + j) & (capacity - 1)];
+		ring[i].swap(plane);
+	}
+
+	capacity = new_capacity;
+	read_pos = 0;
+}
+
+void AudioJitterBuffer::Write(const float **data, size_t frames)
+{
+	Reserve(frames);
+
+	size_t pos = (read_pos + buffered) & (capacity - 1);
+	size_t first = std::min(frames, capacity - pos);
+
+	for (size_t i = 0; i < channels; i++) {
+		float *plane = ring[i].data();
+		memcpy(plane + pos, data[i], first * sizeof(float));
+		memcpy(plane, data[i] + first,
+		       (frames - first) * sizeof(float));
+	}
+}
+
+void AudioJitterBuffer::Output(obs_source_t *source, size_t frames)
+{
+	while (frames) {
+		/* Whatever wraps around the end of the ring goes out as a
+		 * second packet that continues the timeline */
+		size_t count = std::min(frames, capacity - read_pos);
+
+		struct obs_source_audio audio = {};
+		for (size_t i = 0; i < channels; i++)
+			audio.data[i] =
+				(const uint8_t *)(ring[i].data() + read_pos);
+		audio.samples_per_sec = sample_rate;
+		audio.frames = (uint32_t)count;
+		audio.format = AUDIO_FORMAT_FLOAT_PLANAR;
+		audio.speakers = speakers;
+		audio.timestamp = next_ts;
+		obs_source_output_audio(source, &audio);
+		UpdateLatency(next_ts);
+
+		read_pos = (read_pos + count) & (capacity - 1);
+		buffered -= count;
+		frames -= count;
+		next_ts += FramesToNs(count);
+	}
+}
+
+void AudioJitterBuffer::Drain(obs_source_t *source, bool all)
+{
+	/* The target depth stays behind to cover for late packets, the rest
+	 * goes out right away rather than waiting for a full OBS block.  At
+	 * least a fade's worth is held, so FadeOut always has audio left that
+	 * OBS hasn't been given yet. */
+	size_t target = all ? 0 : std::max(NsToFrames(Depth()), FadeFrames());
+	if (buffered > target)
+		Output(source, buffered - target);
+
+	stat_buffered = (uint32_t)buffered;
+}
+
+void AudioJitterBuffer::Start(obs_source_t *source, speaker_layout speakers_,
+			      uint32_t sample_rate_)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (buffered)
+		Drain(source, true);
+	started = false;
+
+	speakers = speakers_;
+	channels = std::min(get_audio_channels(speakers),
+			    (size_t)MAX_AV_PLANES);
+	sample_rate = sample_rate_;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		ring[i].clear();
+	capacity = 0;
+	read_pos = 0;
+
+	/* Room for the deepest the buffer gets plus a packet on top, so it
+	 * normally never has to grow */
+	if (sample_rate)
+		Reserve(NsToFrames(MAX_DEPTH_NS) + AUDIO_OUTPUT_FRAMES * 2);
+
+	/* A new stream has its own timestamps and arrival pattern, but the
+	 * jitter estimate is kept so the depth doesn't start from scratch */
+	have_last = false;
+}
+
+void AudioJitterBuffer::Push(obs_source_t *source, const float **data,
+			     size_t frames, uint64_t ts)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!channels || !sample_rate || !frames)
+		return;
+
+	UpdateJitter(os_gettime_ns(), ts);
+	last_frames = frames;
+
+	if (!started) {
+		started = true;
+		next_ts = ts;
+		drift_ns = 0.0;
+	} else {
+		uint64_t expected = next_ts + FramesToNs(buffered);
+		int64_t drift = (int64_t)(ts - expected);
+
+		/* Too far off to be jitter or drift, the stream skipped or
+		 * jumped, so what is held goes out on the old timeline */
+		if (drift > (int64_t)MAX_DEPTH_NS ||
+		    drift < -(int64_t)MAX_DEPTH_NS) {
+			if (drift > 0)
+				stat_underruns++;
+			else
+				stat_corrections++;
+
+			Drain(source, true);
+			next_ts = ts;
+			drift_ns = 0.0;
+		} else {
+			Slew(drift, frames);
+		}
+	}
+
+	Write(data, frames);
+
+	if (fade_in) {
+		size_t fade_frames = FadeFrames();
+		size_t done = fade_frames - fade_in;
+		size_t count = std::min(fade_in, frames);
+		size_t pos = read_pos + buffered;
+
+		for (size_t i = 0; i < channels; i++) {
+			float *plane = ring[i].data();
+			for (size_t j = 0; j < count; j++)
+				plane[(pos + j) & (capacity - 1)] *=
+					(float)(done + j) / (float)fade_frames;
+		}
+		fade_in -= count;
+	}
+
+	buffered += frames;
+
+	Drain(source, false);
+}
+
+void AudioJitterBuffer::Flush(obs_source_t *source)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (buffered)
+		Drain(source, true);
+	started = false;
+}
+
+void AudioJitterBuffer::FlushIdle(obs_source_t *source)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	/* Idle once the next packet is later than the depth covers for.  The
+	 * timeline carries on if the stream turns out to only have been
+	 * late. */
+	uint64_t idle = FramesToNs(last_frames) + Depth();
+	if (buffered && os_gettime_ns() - last_arrival > idle)
+		Drain(source, true);
+}
+
+void AudioJitterBuffer::FadeOut(obs_source_t *source)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t count = std::min(buffered, FadeFrames());
+	size_t pos = read_pos + buffered - count;
+
+	for (size_t i = 0; i < channels; i++) {
+		float *plane = ring[i].data();
+		for (size_t j = 0; j < count; j++)
+			plane[(pos + j) & (capacity - 1)] *=
+				(float)(count - j) / (float)count;
+	}
+
+	fade_in = 0;
+	if (buffered)
+		Drain(source, true);
+	started = false;
+}
+
+void AudioJitterBuffer::FadeIn()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	fade_in = FadeFrames();
+}
+
+AudioBufferStats AudioJitterBuffer::GetStats() const
+{
+	AudioBufferStats stats;
+	stats.buffered_frames = stat_buffered;
+	stats.depth_ms = stat_depth_ms;
+	stats.jitter_ms = stat_jitter_ms;
+	stats.underruns = stat_underruns;
+	stats.corrections = stat_corrections;
+	stats.buffer_latency_ms = stat_buffer_latency_ms;
+	stats.max_buffer_latency_ms = stat_max_buffer_latency_ms;
+	return stats;
+}
+
+static bool IsSilent(const float *samples, size_t frames)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 threshold = _mm_set1_ps(SILENCE_THRESHOLD);
+	size_t i = 0;
+
+	for (; i + 16 <= frames; i += 16) {
+		__m128 a = _mm_and_ps(_mm_loadu_ps(samples + i), abs_mask);
+		__m128 b = _mm_and_ps(_mm_loadu_ps(samples + i + 4), abs_mask);
+		__m128 c = _mm_and_ps(_mm_loadu_ps(samples + i + 8), abs_mask);
+		__m128 d = _mm_and_ps(_mm_loadu_ps(samples + i + 12), abs_mask);
+		__m128 peak = _mm_max_ps(_mm_max_ps(a, b), _mm_max_ps(c, d));
+		if (_mm_movemask_ps(_mm_cmpgt_ps(peak, threshold)))
+			return false;
+	}
+	for (; i < frames; i++) {
+		if (fabsf(samples[i]) > SILENCE_THRESHOLD)
+			return false;
+	}
+	return true;
+}
+
+bool AudioSilenceGate::Process(const float **data, size_t channels,
+			       size_t frames, uint64_t ts, bool &changed)
+{
+	uint64_t hold = hold_ns;
+	bool was_gated = gated;
+
+	bool packet_silent = hold != 0;
+	for (size_t i = 0; packet_silent && i < channels; i++)
+		packet_silent = IsSilent(data[i], frames);
+
+	if (!packet_silent) {
+		silent = false;
+		gated = false;
+	} else if (!silent) {
+		silent = true;
+		silent_since = ts;
+	} else if (ts - silent_since >= hold) {
+		gated = true;
+	}
+
+	changed = gated != was_gated;
+	return !gated;
+}
+
+void AudioSilenceGate::Reset()
+{
+	silent = false;
+	gated = false;
+}
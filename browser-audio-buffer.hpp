@@ -0,0 +1,140 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#pragma once
+
+#include <obs-module.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+struct AudioBufferStats {
+	uint32_t buffered_frames;
+	uint32_t depth_ms;
+	double jitter_ms;
+	uint64_t underruns;
+	uint64_t corrections;
+	double buffer_latency_ms;
+	double max_buffer_latency_ms;
+};
+
+/* Sits between CEF and obs_source_output_audio.  CEF packets arrive with
+ * jittery timestamps, so they are collected in a ring buffer and output on
+ * a continuous timeline.  Whatever is above the target depth goes out with
+ * every packet, so the audio buffer size setting sets the granularity.
+ *
+ * A target depth that follows the measured packet jitter, up to 100 ms, is
+ * held back so a late packet doesn't leave a hole.  Drift between incoming
+ * timestamps and the timeline is corrected a little with every packet, and
+ * only a jump too large to be jitter restarts the timeline: a gap counts as
+ * an underrun, an overlap as a timestamp correction.
+ *
+ * Buffer latency is measured from the time CEF stamped the audio with to
+ * the time it is handed to OBS, which is what the buffer size and depth
+ * add.  The page's AudioContext output latency comes before that stamp
+ * and OBS's own audio buffering after the hand-off, neither is included.
+ *
+ * GetStats may be called from anywhere, everything else takes the lock so
+ * held audio can also be flushed from the video tick. */
+class AudioJitterBuffer {
+	std::mutex mutex;
+	std::vector<float> ring[MAX_AV_PLANES];
+	size_t capacity = 0;
+	size_t read_pos = 0;
+	size_t buffered = 0;
+	size_t channels = 0;
+	speaker_layout speakers = SPEAKERS_UNKNOWN;
+	uint32_t sample_rate = 0;
+
+	bool started = false;
+	uint64_t next_ts = 0;
+	double drift_ns = 0.0;
+	size_t fade_in = 0;
+
+	bool have_last = false;
+	uint64_t last_arrival = 0;
+	uint64_t last_ts = 0;
+	size_t last_frames = 0;
+	double jitter_ns = 0.0;
+	double latency_ns = 0.0;
+
+	std::atomic<uint32_t> stat_buffered = 0;
+	std::atomic<uint32_t> stat_depth_ms = 0;
+	std::atomic<double> stat_jitter_ms = 0.0;
+	std::atomic<uint64_t> stat_underruns = 0;
+	std::atomic<uint64_t> stat_corrections = 0;
+	std::atomic<double> stat_buffer_latency_ms = 0.0;
+	std::atomic<double> stat_max_buffer_latency_ms = 0.0;
+
+	uint64_t FramesToNs(size_t frames) const;
+	size_t NsToFrames(uint64_t ns) const;
+	size_t FadeFrames() const;
+	uint64_t Depth() const;
+	void UpdateJitter(uint64_t arrival, uint64_t ts);
+	void UpdateLatency(uint64_t ts);
+	void Slew(int64_t drift, size_t frames);
+	void Reserve(size_t frames);
+	void Write(const float **data, size_t frames);
+	void Output(obs_source_t *source, size_t frames);
+	void Drain(obs_source_t *source, bool all);
+
+public:
+	void Start(obs_source_t *source, speaker_layout speakers,
+		   uint32_t sample_rate);
+	void Push(obs_source_t *source, const float **data, size_t frames,
+		  uint64_t ts);
+	void Flush(obs_source_t *source);
+
+	/* Outputs the held audio once nothing has arrived for longer than
+	 * the depth, so the end of a stream isn't stuck waiting for a packet
+	 * that never comes */
+	void FlushIdle(obs_source_t *source);
+
+	/* Fades out the audio held back at the end of the buffer before
+	 * flushing it, and fades in the audio that follows, so suspending and
+	 * resuming output doesn't click */
+	void FadeOut(obs_source_t *source);
+	void FadeIn();
+
+	AudioBufferStats GetStats() const;
+};
+
+/* Stops silent audio from being output once it has lasted for the hold
+ * time, so OBS doesn't keep mixing zeros from pages that created an audio
+ * context but aren't playing anything.  The first packet with sound opens
+ * the gate again.
+ *
+ * Process is called from the CEF audio thread only. */
+class AudioSilenceGate {
+	std::atomic<uint64_t> hold_ns = 0;
+	bool silent = false;
+	uint64_t silent_since = 0;
+	bool gated = false;
+
+public:
+	inline void SetHoldTime(uint32_t ms)
+	{
+		hold_ns = (uint64_t)ms * 1000000ULL;
+	}
+
+	/* Returns whether the packet should be output, and sets changed when
+	 * the gate opened or closed */
+	bool Process(const float **data, size_t channels, size_t frames,
+		     uint64_t ts, bool &changed);
+	inline bool Gated() const { return gated; }
+	void Reset();
+};
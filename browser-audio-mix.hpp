@@ -0,0 +1,44 @@
+/******************************************************************************
+ Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#pragma once
+
+#include <util/sse-intrin.h>
+#include <stddef.h>
+
+/* Adds count samples of in, starting at pos, onto out.  Used by
+ * BrowserSource::AudioMix, which runs once per audio tick for every stream
+ * of a browser. */
+static inline void mix_audio(float *__restrict p_out,
+			     const float *__restrict p_in, size_t pos,
+			     size_t count)
+{
+	float *__restrict out = p_out;
+	const float *__restrict in = p_in + pos;
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 a = _mm_add_ps(_mm_loadu_ps(out + i),
+				      _mm_loadu_ps(in + i));
+		__m128 b = _mm_add_ps(_mm_loadu_ps(out + i + 4),
+				      _mm_loadu_ps(in + i + 4));
+		_mm_storeu_ps(out + i, a);
+		_mm_storeu_ps(out + i + 4, b);
+	}
+	for (; i < count; i++)
+		out[i] += in[i];
+}
@@ -0,0 +1,450 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "browser-audio-remix.hpp"
+
+#include <util/sse-intrin.h>
+#include <algorithm>
+#include <cstring>
+
+#define EQUAL_POWER 0.70710678f /* -3 dB */
+#define HALF_POWER 0.5f         /* -6 dB */
+
+enum Position {
+	NONE,
+	FL,
+	FR,
+	FC,
+	LFE,
+	BL,
+	BR,
+	FLC,
+	FRC,
+	BC,
+	SL,
+	SR,
+	POSITION_COUNT,
+};
+
+struct Layout {
+	speaker_layout exact;
+	Position positions[MAX_AV_PLANES];
+};
+
+/* Plane order of each CEF layout, as Chromium delivers it.  Positions past
+ * the channel count stay NONE. */
+static bool GetLayout(cef_channel_layout_t layout, Layout &out)
+{
+	static const Layout mono = {SPEAKERS_MONO, {FC}};
+	static const Layout stereo = {SPEAKERS_STEREO, {FL, FR}};
+	static const Layout two_point_one = {SPEAKERS_2POINT1,
+					     {FL, FR, LFE}};
+	static const Layout four_zero = {SPEAKERS_4POINT0,
+					 {FL, FR, FC, BC}};
+	static const Layout four_one = {SPEAKERS_4POINT1,
+					{FL, FR, FC, LFE, BC}};
+	static const Layout five_one = {SPEAKERS_5POINT1,
+					{FL, FR, FC, LFE, SL, SR}};
+	static const Layout five_one_back = {SPEAKERS_5POINT1,
+					     {FL, FR, FC, LFE, BL, BR}};
+	static const Layout seven_one = {SPEAKERS_7POINT1,
+					 {FL, FR, FC, LFE, BL, BR, SL, SR}};
+
+	static const Layout two_one = {SPEAKERS_UNKNOWN, {FL, FR, BC}};
+	static const Layout surround = {SPEAKERS_UNKNOWN, {FL, FR, FC}};
+	static const Layout two_two = {SPEAKERS_UNKNOWN,
+				       {FL, FR, SL, SR}};
+	static const Layout quad = {SPEAKERS_UNKNOWN, {FL, FR, BL, BR}};
+	static const Layout five_zero = {SPEAKERS_UNKNOWN,
+					 {FL, FR, FC, SL, SR}};
+	static const Layout five_zero_back = {SPEAKERS_UNKNOWN,
+					      {FL, FR, FC, BL, BR}};
+	static const Layout seven_zero = {SPEAKERS_UNKNOWN,
+					  {FL, FR, FC, SL, SR, BL, BR}};
+	static const Layout seven_one_wide = {
+		SPEAKERS_UNKNOWN, {FL, FR, FC, LFE, SL, SR, FLC, FRC}};
+	static const Layout three_one = {SPEAKERS_UNKNOWN,
+					 {FL, FR, FC, LFE}};
+	static const Layout six_zero = {SPEAKERS_UNKNOWN,
+					{FL, FR, FC, SL, SR, BC}};
+	static const Layout six_zero_front = {
+		SPEAKERS_UNKNOWN, {FL, FR, SL, SR, FLC, FRC}};
+	static const Layout hexagonal = {SPEAKERS_UNKNOWN,
+					 {FL, FR, FC, BL, BR, BC}};
+	static const Layout six_one = {SPEAKERS_UNKNOWN,
+				       {FL, FR, FC, LFE, SL, SR, BC}};
+	static const Layout six_one_back = {
+		SPEAKERS_UNKNOWN, {FL, FR, FC, LFE, BL, BR, BC}};
+	static const Layout six_one_front = {
+		SPEAKERS_UNKNOWN, {FL, FR, SL, SR, FLC, FRC, LFE}};
+	static const Layout seven_zero_front = {
+		SPEAKERS_UNKNOWN, {FL, FR, FC, SL, SR, FLC, FRC}};
+	static const Layout seven_one_wide_back = {
+		SPEAKERS_UNKNOWN, {FL, FR, FC, LFE, BL, BR, FLC, FRC}};
+	static const Layout octagonal = {SPEAKERS_UNKNOWN,
+					 {FL, FR, FC, SL, SR, BL, BR, BC}};
+	static const Layout quad_side = {SPEAKERS_UNKNOWN,
+					 {FL, FR, SL, SR, LFE}};
+
+	switch (layout) {
+	case CEF_CHANNEL_LAYOUT_MONO:
+		out = mono;
+		return true;
+	case CEF_CHANNEL_LAYOUT_STEREO:
+	case CEF_CHANNEL_LAYOUT_STEREO_DOWNMIX:
+	case CEF_CHANNEL_LAYOUT_STEREO_AND_KEYBOARD_MIC:
+		out = stereo;
+		return true;
+	case CEF_CHANNEL_LAYOUT_2POINT1:
+		out = two_point_one;
+		return true;
+	case CEF_CHANNEL_LAYOUT_4_0:
+		out = four_zero;
+		return true;
+	case CEF_CHANNEL_LAYOUT_4_1:
+		out = four_one;
+		return true;
+	case CEF_CHANNEL_LAYOUT_5_1:
+		out = five_one;
+		return true;
+	case CEF_CHANNEL_LAYOUT_5_1_BACK:
+		out = five_one_back;
+		return true;
+	case CEF_CHANNEL_LAYOUT_7_1:
+		out = seven_one;
+		return true;
+	case CEF_CHANNEL_LAYOUT_2_1:
+		out = two_one;
+		return true;
+	case CEF_CHANNEL_LAYOUT_SURROUND:
+		out = surround;
+		return true;
+	case CEF_CHANNEL_LAYOUT_2_2:
+		out = two_two;
+		return true;
+	case CEF_CHANNEL_LAYOUT_QUAD:
+		out = quad;
+		return true;
+	case CEF_CHANNEL_LAYOUT_5_0:
+		out = five_zero;
+		return true;
+	case CEF_CHANNEL_LAYOUT_5_0_BACK:
+		out = five_zero_back;
+		return true;
+	case CEF_CHANNEL_LAYOUT_7_0:
+		out = seven_zero;
+		return true;
+	case CEF_CHANNEL_LAYOUT_7_1_WIDE:
+		out = seven_one_wide;
+		return true;
+	case CEF_CHANNEL_LAYOUT_3_1:
+		out = three_one;
+		return true;
+	case CEF_CHANNEL_LAYOUT_6_0:
+		out = six_zero;
+		return true;
+	case CEF_CHANNEL_LAYOUT_6_0_FRONT:
+		out = six_zero_front;
+		return true;
+	case CEF_CHANNEL_LAYOUT_HEXAGONAL:
+		out = hexagonal;
+		return true;
+	case CEF_CHANNEL_LAYOUT_6_1:
+		out = six_one;
+		return true;
+	case CEF_CHANNEL_LAYOUT_6_1_BACK:
+		out = six_one_back;
+		return true;
+	case CEF_CHANNEL_LAYOUT_6_1_FRONT:
+		out = six_one_front;
+		return true;
+	case CEF_CHANNEL_LAYOUT_7_0_FRONT:
+		out = seven_zero_front;
+		return true;
+	case CEF_CHANNEL_LAYOUT_7_1_WIDE_BACK:
+		out = seven_one_wide_back;
+		return true;
+	case CEF_CHANNEL_LAYOUT_OCTAGONAL:
+		out = octagonal;
+		return true;
+	case CEF_CHANNEL_LAYOUT_4_1_QUAD_SIDE:
+		out = quad_side;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Plane order of each OBS layout */
+static void GetOutputPositions(speaker_layout speakers,
+			       Position (&out)[MAX_AV_PLANES])
+{
+	Layout layout;
+
+	switch (speakers) {
+	case SPEAKERS_MONO:
+		GetLayout(CEF_CHANNEL_LAYOUT_MONO, layout);
+		break;
+	case SPEAKERS_2POINT1:
+		GetLayout(CEF_CHANNEL_LAYOUT_2POINT1, layout);
+		break;
+	case SPEAKERS_4POINT0:
+		GetLayout(CEF_CHANNEL_LAYOUT_4_0, layout);
+		break;
+	case SPEAKERS_4POINT1:
+		GetLayout(CEF_CHANNEL_LAYOUT_4_1, layout);
+		break;
+	case SPEAKERS_5POINT1:
+		GetLayout(CEF_CHANNEL_LAYOUT_5_1_BACK, layout);
+		break;
+	case SPEAKERS_7POINT1:
+		GetLayout(CEF_CHANNEL_LAYOUT_7_1, layout);
+		break;
+	default:
+		GetLayout(CEF_CHANNEL_LAYOUT_STEREO, layout);
+		break;
+	}
+
+	std::copy(layout.positions, layout.positions + MAX_AV_PLANES, out);
+}
+
+struct Target {
+	Position position;
+	float coefficient;
+};
+
+/* Where a channel goes when the output layout doesn't have it.  LFE is
+ * dropped as in ITU-R BS.775, everything else folds into the nearest
+ * speakers that exist. */
+static size_t GetDownmixTargets(Position in,
+				const bool (&has)[POSITION_COUNT],
+				Target (&targets)[2])
+{
+	if (has[in]) {
+		targets[0] = {in, 1.0f};
+		return 1;
+	}
+
+	switch (in) {
+	case FC:
+		if (has[FL] && has[FR]) {
+			targets[0] = {FL, EQUAL_POWER};
+			targets[1] = {FR, EQUAL_POWER};
+			return 2;
+		}
+		break;
+	case FL:
+	case FR:
+		if (has[FC]) {
+			targets[0] = {FC, EQUAL_POWER};
+			return 1;
+		}
+		break;
+	case FLC:
+	case FRC: {
+		Position side = in == FLC ? FL : FR;
+		if (has[side] && has[FC]) {
+			targets[0] = {side, EQUAL_POWER};
+			targets[1] = {FC, EQUAL_POWER};
+			return 2;
+		} else if (has[side]) {
+			targets[0] = {side, 1.0f};
+			return 1;
+		} else if (has[FC]) {
+			targets[0] = {FC, EQUAL_POWER};
+			return 1;
+		}
+		break;
+	}
+	case SL:
+	case SR:
+	case BL:
+	case BR: {
+		bool left = in == SL || in == BL;
+		Position other = in == SL ? BL
+				 : in == SR ? BR
+				 : in == BL ? SL
+					    : SR;
+		if (has[other]) {
+			targets[0] = {other, 1.0f};
+			return 1;
+		} else if (has[BC]) {
+			targets[0] = {BC, EQUAL_POWER};
+			return 1;
+		} else if (has[left ? FL : FR]) {
+			targets[0] = {left ? FL : FR, EQUAL_POWER};
+			return 1;
+		} else if (has[FC]) {
+			targets[0] = {FC, HALF_POWER};
+			return 1;
+		}
+		break;
+	}
+	case BC:
+		if (has[BL] && has[BR]) {
+			targets[0] = {BL, EQUAL_POWER};
+			targets[1] = {BR, EQUAL_POWER};
+			return 2;
+		} else if (has[SL] && has[SR]) {
+			targets[0] = {SL, EQUAL_POWER};
+			targets[1] = {SR, EQUAL_POWER};
+			return 2;
+		} else if (has[FL] && has[FR]) {
+			targets[0] = {FL, HALF_POWER};
+			targets[1] = {FR, HALF_POWER};
+			return 2;
+		} else if (has[FC]) {
+			targets[0] = {FC, HALF_POWER};
+			return 1;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+speaker_layout AudioRemixer::Configure(cef_channel_layout_t cef_layout,
+				       int channels, size_t frames)
+{
+	return Configure(cef_layout, channels, frames,
+			 audio_output_get_info(obs_get_audio())->speakers);
+}
+
+speaker_layout AudioRemixer::Configure(cef_channel_layout_t cef_layout,
+				       int channels, size_t frames,
+				       speaker_layout speakers)
+{
+	Layout layout;
+	bool known = GetLayout(cef_layout, layout);
+
+	in_channels = std::clamp(channels, 0, MAX_AV_PLANES);
+	passthrough = known && layout.exact != SPEAKERS_UNKNOWN &&
+		      get_audio_channels(layout.exact) == in_channels;
+	if (passthrough) {
+		out_channels = in_channels;
+		return layout.exact;
+	}
+
+	Position out_positions[MAX_AV_PLANES];
+	GetOutputPositions(speakers, out_positions);
+
+	out_channels = get_audio_channels(speakers);
+	memset(matrix, 0, sizeof(matrix));
+
+	if (known) {
+		bool has[POSITION_COUNT] = {};
+		size_t out_index[POSITION_COUNT] = {};
+		for (size_t o = 0; o < out_channels; o++) {
+			has[out_positions[o]] = true;
+			out_index[out_positions[o]] = o;
+		}
+
+		for (size_t i = 0; i < in_channels; i++) {
+			Position in = layout.positions[i];
+			if (in == NONE)
+				continue;
+
+			Target targets[2];
+			size_t count = GetDownmixTargets(in, has, targets);
+			for (size_t t = 0; t < count; t++) {
+				size_t o = out_index[targets[t].position];
+				matrix[o][i] += targets[t].coefficient;
+			}
+		}
+	} else {
+		/* Discrete or unknown layouts have no positions to go by */
+		for (size_t i = 0; i < std::min(in_channels, out_channels); i++)
+			matrix[i][i] = 1.0f;
+	}
+
+	for (size_t o = 0; o < MAX_AV_PLANES; o++) {
+		buffers[o].clear();
+		if (o < out_channels)
+			buffers[o].resize(frames);
+		planes[o] = o < out_channels ? buffers[o].data() : nullptr;
+	}
+
+	blog(LOG_INFO,
+	     "[obs-browser]: Remixing CEF channel layout %d (%d channels) "
+	     "to %d OBS channels",
+	     (int)cef_layout, channels, (int)out_channels);
+	return speakers;
+}
+
+static inline void scale(float *__restrict out, const float *__restrict in,
+			 float coefficient, size_t frames)
+{
+	__m128 c = _mm_set1_ps(coefficient);
+	size_t i = 0;
+	for (; i + 4 <= frames; i += 4)
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), c));
+	for (; i < frames; i++)
+		out[i] = in[i] * coefficient;
+}
+
+static inline void scale_add(float *__restrict out,
+			     const float *__restrict in, float coefficient,
+			     size_t frames)
+{
+	__m128 c = _mm_set1_ps(coefficient);
+	size_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128 mixed = _mm_add_ps(_mm_loadu_ps(out + i),
+					  _mm_mul_ps(_mm_loadu_ps(in + i), c));
+		_mm_storeu_ps(out + i, mixed);
+	}
+	for (; i < frames; i++)
+		out[i] += in[i] * coefficient;
+}
+
+const float **AudioRemixer::Process(const float **data, size_t frames)
+{
+	if (passthrough)
+		return data;
+
+	for (size_t o = 0; o < out_channels; o++) {
+		/* Only grows if CEF sends more than it announced */
+		if (buffers[o].size() < frames) {
+			buffers[o].resize(frames);
+			planes[o] = buffers[o].data();
+		}
+
+		float *out = buffers[o].data();
+		bool written = false;
+
+		for (size_t i = 0; i < in_channels; i++) {
+			float coefficient = matrix[o][i];
+			if (coefficient == 0.0f)
+				continue;
+
+			if (!written && coefficient == 1.0f)
+				memcpy(out, data[i], frames * sizeof(float));
+			else if (!written)
+				scale(out, data[i], coefficient, frames);
+			else
+				scale_add(out, data[i], coefficient, frames);
+			written = true;
+		}
+
+		if (!written)
+			memset(out, 0, frames * sizeof(float));
+	}
+
+	return planes;
+}
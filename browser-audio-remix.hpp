@@ -0,0 +1,51 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#pragma once
+
+#include "cef-headers.hpp"
+#include <obs-module.h>
+#include <vector>
+
+/* Maps the planes of a CEF audio stream onto an OBS speaker layout.
+ *
+ * CEF layouts that OBS has an exact equivalent for are passed through
+ * untouched.  Anything else (side/back variants, front-of-center, 6.x,
+ * hexagonal, octagonal, discrete) is remixed onto the OBS output layout
+ * with ITU-R BS.775 style downmix coefficients.  Buffers are allocated
+ * when the stream starts, so the packet path doesn't allocate. */
+class AudioRemixer {
+	float matrix[MAX_AV_PLANES][MAX_AV_PLANES] = {};
+	size_t in_channels = 0;
+	size_t out_channels = 0;
+	bool passthrough = true;
+
+	std::vector<float> buffers[MAX_AV_PLANES];
+	const float *planes[MAX_AV_PLANES] = {};
+
+public:
+	/* Returns the layout of the planes that Process hands back */
+	speaker_layout Configure(cef_channel_layout_t layout, int channels,
+				 size_t frames);
+	/* Remixes onto the given layout instead of the OBS output's */
+	speaker_layout Configure(cef_channel_layout_t layout, int channels,
+				 size_t frames, speaker_layout speakers);
+	const float **Process(const float **data, size_t frames);
+
+	inline bool Passthrough() const { return passthrough; }
+	inline size_t Channels() const { return out_channels; }
+};
@@ -18,10 +18,14 @@
 
 #include "browser-client.hpp"
 #include "obs-browser-source.hpp"
+#include "browser-state.hpp"
+#include "browser-shared-data.hpp"
 #include "base64/base64.hpp"
 #include <nlohmann/json.hpp>
 //#include <obs-frontend-api.h>
 #include <obs.hpp>
+#include <chrono>
+#include <unordered_map>
 #include <util/platform.h>
 #if defined(__APPLE__) && CHROME_VERSION_BUILD > 4430
 #include <IOSurface/IOSurface.h>
@@ -99,6 +103,31 @@ bool BrowserClient::OnBeforePopup(CefRefPtr<CefBrowser>, CefRefPtr<CefFrame>,
 	return true;
 }
 
+void BrowserClient::OnAfterCreated(CefRefPtr<CefBrowser> browser)
+{
+	if (pooled) {
+		AddPooledBrowser(browser, this);
+		return;
+	}
+
+	BrowserOpened();
+	if (bs) {
+		bs->OnBrowserCreated(this, browser);
+	} else {
+		/* The source let go of it while it was being created */
+		browser->GetHost()->CloseBrowser(true);
+	}
+}
+
+void BrowserClient::OnBeforeClose(CefRefPtr<CefBrowser>)
+{
+	if (shared_data_reads)
+		RemoveSharedDataReader();
+	shared_data_reads = 0;
+
+	BrowserClosed();
+}
+
 void BrowserClient::OnBeforeContextMenu(CefRefPtr<CefBrowser>,
 					CefRefPtr<CefFrame>,
 					CefRefPtr<CefContextMenuParams>,
@@ -108,155 +137,248 @@ void BrowserClient::OnBeforeContextMenu(CefRefPtr<CefBrowser>,
 	model->Clear();
 }
 
+#if BROWSER_FRONTEND_API_SUPPORT_ENABLED
+struct RequestContext {
+	BrowserSource *bs;
+	CefRefPtr<CefBrowser> browser;
+	CefRefPtr<CefListValue> args;
+	ControlLevel level;
+	std::string reply = "null";
+};
+
+struct RequestHandler {
+	ControlLevel level;
+	void (*handle)(RequestContext &ctx);
+};
+
+static void SetCurrentScene(RequestContext &ctx)
+{
+	const std::string scene_name = ctx.args->GetString(1).ToString();
+	OBSSourceAutoRelease source =
+		obs_get_source_by_name(scene_name.c_str());
+	if (!source) {
+		blog(LOG_WARNING,
+		     "Browser source '%s' tried to switch to scene '%s' which doesn't exist",
+		     obs_source_get_name(ctx.bs->source), scene_name.c_str());
+	} else if (!obs_source_is_scene(source)) {
+		blog(LOG_WARNING,
+		     "Browser source '%s' tried to switch to '%s' which isn't a scene",
+		     obs_source_get_name(ctx.bs->source), scene_name.c_str());
+	} else {
+		obs_frontend_set_current_scene(source);
+	}
+}
+
+static void SetCurrentTransition(RequestContext &ctx)
+{
+	const std::string transition_name = ctx.args->GetString(1).ToString();
+	obs_frontend_source_list transitions = {};
+	obs_frontend_get_transitions(&transitions);
+
+	OBSSourceAutoRelease transition;
+	for (size_t i = 0; i < transitions.sources.num; i++) {
+		obs_source_t *source = transitions.sources.array[i];
+		if (obs_source_get_name(source) == transition_name) {
+			transition = obs_source_get_ref(source);
+			break;
+		}
+	}
+
+	obs_frontend_source_list_free(&transitions);
+
+	if (transition)
+		obs_frontend_set_current_transition(transition);
+	else
+		blog(LOG_WARNING,
+		     "Browser source '%s' tried to change the current transition to '%s' which doesn't exist",
+		     obs_source_get_name(ctx.bs->source),
+		     transition_name.c_str());
+}
+
+static void Subscribe(RequestContext &ctx)
+{
+	uint32_t topics = GetStateTopics(ctx.args, 1) &
+			  GetAllowedStateTopics(ctx.level);
+	SubscribeState(ctx.bs, ctx.browser, topics);
+
+	nlohmann::json json = GetStateTopicNames(topics);
+	ctx.reply = json.dump();
+}
+
+/* Each request carries the lowest control level allowed to issue it.  Read
+ * requests are answered from the state cache in browser-state.cpp, so the
+ * frontend lists are only enumerated again after they changed. */
+static const std::unordered_map<std::string, RequestHandler> request_handlers = {
+	{"startRecording",
+	 {ControlLevel::All,
+	  [](RequestContext &) { obs_frontend_recording_start(); }}},
+	{"stopRecording",
+	 {ControlLevel::All,
+	  [](RequestContext &) { obs_frontend_recording_stop(); }}},
+	{"startStreaming",
+	 {ControlLevel::All,
+	  [](RequestContext &) { obs_frontend_streaming_start(); }}},
+	{"stopStreaming",
+	 {ControlLevel::All,
+	  [](RequestContext &) { obs_frontend_streaming_stop(); }}},
+	{"pauseRecording",
+	 {ControlLevel::All,
+	  [](RequestContext &) { obs_frontend_recording_pause(true); }}},
+	{"unpauseRecording",
+	 {ControlLevel::All,
+	  [](RequestContext &) { obs_frontend_recording_pause(false); }}},
+	{"startVirtualcam",
+	 {ControlLevel::All,
+	  [](RequestContext &) { obs_frontend_start_virtualcam(); }}},
+	{"stopVirtualcam",
+	 {ControlLevel::All,
+	  [](RequestContext &) { obs_frontend_stop_virtualcam(); }}},
+	{"startReplayBuffer",
+	 {ControlLevel::Advanced,
+	  [](RequestContext &) { obs_frontend_replay_buffer_start(); }}},
+	{"stopReplayBuffer",
+	 {ControlLevel::Advanced,
+	  [](RequestContext &) { obs_frontend_replay_buffer_stop(); }}},
+	{"setCurrentScene", {ControlLevel::Advanced, SetCurrentScene}},
+	{"setCurrentTransition", {ControlLevel::Advanced, SetCurrentTransition}},
+	{"saveReplayBuffer",
+	 {ControlLevel::Basic,
+	  [](RequestContext &) { obs_frontend_replay_buffer_save(); }}},
+	{"getScenes",
+	 {ControlLevel::ReadUser,
+	  [](RequestContext &ctx) { ctx.reply = GetStateJson(STATE_SCENES); }}},
+	{"getCurrentScene",
+	 {ControlLevel::ReadUser,
+	  [](RequestContext &ctx) {
+		  ctx.reply = GetStateJson(STATE_CURRENT_SCENE);
+	  }}},
+	{"getTransitions",
+	 {ControlLevel::ReadUser,
+	  [](RequestContext &ctx) {
+		  ctx.reply = GetStateJson(STATE_TRANSITIONS);
+	  }}},
+	{"getCurrentTransition",
+	 {ControlLevel::ReadUser,
+	  [](RequestContext &ctx) {
+		  ctx.reply = GetStateJson(STATE_CURRENT_TRANSITION);
+	  }}},
+	{"getStatus",
+	 {ControlLevel::ReadObs,
+	  [](RequestContext &ctx) { ctx.reply = GetStateJson(STATE_STATUS); }}},
+	{"getControlLevel",
+	 {ControlLevel::None,
+	  [](RequestContext &ctx) {
+		  ctx.reply = std::to_string((int)ctx.level);
+	  }}},
+	{"subscribe", {ControlLevel::None, Subscribe}},
+	{"getState",
+	 {ControlLevel::None,
+	  [](RequestContext &ctx) { ctx.reply = GetStateSnapshot(ctx.level); }}},
+};
+#endif
+
+#if ENABLE_PAGE_AUDIO_STREAMS
+/* The renderer copied each channel out of the page's ArrayBuffer into a
+ * CefBinaryValue.  Those are read in place here, and copied once more into
+ * the ring of the stream's jitter buffer.  Follows the source's own audio:
+ * nothing is output while audio isn't rerouted to OBS or while the source
+ * has it suspended. */
+void BrowserClient::OutputPageAudio(CefRefPtr<CefListValue> args)
+{
+	if (!reroute_audio || bs->audio_suspended)
+		return;
+	if (args->GetSize() < 4 || args->GetSize() - 3 > MAX_AV_PLANES)
+		return;
+
+	int sample_rate = args->GetInt(1);
+	if (sample_rate <= 0)
+		return;
+
+	/* The page and this process read the same steady clock */
+	double sent_us = args->GetDouble(2);
+	double now_us =
+		(double)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch())
+			.count();
+	uint64_t delay = now_us > sent_us
+				 ? (uint64_t)((now_us - sent_us) * 1000.0)
+				 : 0;
+
+	size_t channels = args->GetSize() - 3;
+
+	const float *planes[MAX_AV_PLANES] = {};
+	size_t frames = 0;
+
+	/* Every channel has to have the same number of samples */
+	for (size_t i = 0; i < channels; i++) {
+		CefRefPtr<CefBinaryValue> plane = args->GetBinary(3 + i);
+		if (!plane)
+			return;
+
+		size_t plane_frames = plane->GetSize() / sizeof(float);
+		if (i > 0 && plane_frames != frames)
+			return;
+
+		planes[i] = (const float *)plane->GetRawData();
+		frames = plane_frames;
+	}
+
+	if (!frames)
+		return;
+
+	bs->OutputPageAudio(args->GetString(0).ToString(),
+			    (uint32_t)sample_rate, planes, channels, frames,
+			    delay);
+}
+#endif
+
 bool BrowserClient::OnProcessMessageReceived(
 	CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame>, CefProcessId,
 	CefRefPtr<CefProcessMessage> message)
 {
 	const std::string &name = message->GetName();
 	CefRefPtr<CefListValue> input_args = message->GetArgumentList();
-	nlohmann::json json;
+	std::string json = "null";
+
+	/* Counted per page rather than as a flag, as the page navigated away
+	 * from may be in another render process, and its release can arrive
+	 * after the new page's first read.  Handled even while the source
+	 * lets go of the browser, so the count always goes back down. */
+	if (name == "readSharedData") {
+		if (input_args->GetBool(0)) {
+			if (shared_data_reads++ == 0)
+				AddSharedDataReader();
+		} else if (shared_data_reads > 0) {
+			if (--shared_data_reads == 0)
+				RemoveSharedDataReader();
+		}
+		return true;
+	}
 
 	if (!valid()) {
 		return false;
 	}
-#if BROWSER_FRONTEND_API_SUPPORT_ENABLED
-	// Fall-through switch, so that higher levels also have lower-level rights
-	switch (webpage_control_level) {
-	case ControlLevel::All:
-		if (name == "startRecording") {
-			obs_frontend_recording_start();
-		} else if (name == "stopRecording") {
-			obs_frontend_recording_stop();
-		} else if (name == "startStreaming") {
-			obs_frontend_streaming_start();
-		} else if (name == "stopStreaming") {
-			obs_frontend_streaming_stop();
-		} else if (name == "pauseRecording") {
-			obs_frontend_recording_pause(true);
-		} else if (name == "unpauseRecording") {
-			obs_frontend_recording_pause(false);
-		} else if (name == "startVirtualcam") {
-			obs_frontend_start_virtualcam();
-		} else if (name == "stopVirtualcam") {
-			obs_frontend_stop_virtualcam();
-		}
-		[[fallthrough]];
-	case ControlLevel::Advanced:
-		if (name == "startReplayBuffer") {
-			obs_frontend_replay_buffer_start();
-		} else if (name == "stopReplayBuffer") {
-			obs_frontend_replay_buffer_stop();
-		} else if (name == "setCurrentScene") {
-			const std::string scene_name =
-				input_args->GetString(1).ToString();
-			OBSSourceAutoRelease source =
-				obs_get_source_by_name(scene_name.c_str());
-			if (!source) {
-				blog(LOG_WARNING,
-				     "Browser source '%s' tried to switch to scene '%s' which doesn't exist",
-				     obs_source_get_name(bs->source),
-				     scene_name.c_str());
-			} else if (!obs_source_is_scene(source)) {
-				blog(LOG_WARNING,
-				     "Browser source '%s' tried to switch to '%s' which isn't a scene",
-				     obs_source_get_name(bs->source),
-				     scene_name.c_str());
-			} else {
-				obs_frontend_set_current_scene(source);
-			}
-		} else if (name == "setCurrentTransition") {
-			const std::string transition_name =
-				input_args->GetString(1).ToString();
-			obs_frontend_source_list transitions = {};
-			obs_frontend_get_transitions(&transitions);
-
-			OBSSourceAutoRelease transition;
-			for (size_t i = 0; i < transitions.sources.num; i++) {
-				obs_source_t *source =
-					transitions.sources.array[i];
-				if (obs_source_get_name(source) ==
-				    transition_name) {
-					transition = obs_source_get_ref(source);
-					break;
-				}
-			}
 
-			obs_frontend_source_list_free(&transitions);
+	if (name == "setVideoTick") {
+		bs->video_tick = input_args->GetBool(0);
+		return true;
+	}
 
-			if (transition)
-				obs_frontend_set_current_transition(transition);
-			else
-				blog(LOG_WARNING,
-				     "Browser source '%s' tried to change the current transition to '%s' which doesn't exist",
-				     obs_source_get_name(bs->source),
-				     transition_name.c_str());
-		}
-		[[fallthrough]];
-	case ControlLevel::Basic:
-		if (name == "saveReplayBuffer") {
-			obs_frontend_replay_buffer_save();
-		}
-		[[fallthrough]];
-	case ControlLevel::ReadUser:
-		if (name == "getScenes") {
-			struct obs_frontend_source_list list = {};
-			obs_frontend_get_scenes(&list);
-			std::vector<nlohmann::json> scenes_vector;
-			for (size_t i = 0; i < list.sources.num; i++) {
-				obs_source_t *source = list.sources.array[i];
-				scenes_vector.push_back(
-					obs_source_get_name(source));
-			}
-			json = scenes_vector;
-			obs_frontend_source_list_free(&list);
-		} else if (name == "getCurrentScene") {
-			OBSSourceAutoRelease current_scene =
-				obs_frontend_get_current_scene();
-
-			if (!current_scene)
-				return false;
-
-			const char *name = obs_source_get_name(current_scene);
-			if (!name)
-				return false;
-
-			json = {{"name", name},
-				{"width", obs_source_get_width(current_scene)},
-				{"height",
-				 obs_source_get_height(current_scene)}};
-		} else if (name == "getTransitions") {
-			struct obs_frontend_source_list list = {};
-			obs_frontend_get_transitions(&list);
-			std::vector<nlohmann::json> transitions_vector;
-			for (size_t i = 0; i < list.sources.num; i++) {
-				obs_source_t *source = list.sources.array[i];
-				transitions_vector.push_back(
-					obs_source_get_name(source));
-			}
-			json = transitions_vector;
-			obs_frontend_source_list_free(&list);
-		} else if (name == "getCurrentTransition") {
-			OBSSourceAutoRelease source =
-				obs_frontend_get_current_transition();
-			json = obs_source_get_name(source);
-		}
-		[[fallthrough]];
-	case ControlLevel::ReadObs:
-		if (name == "getStatus") {
-			json = {{"recording", obs_frontend_recording_active()},
-				{"streaming", obs_frontend_streaming_active()},
-				{"recordingPaused",
-				 obs_frontend_recording_paused()},
-				{"replaybuffer",
-				 obs_frontend_replay_buffer_active()},
-				{"virtualcam",
-				 obs_frontend_virtualcam_active()}};
-		}
-		[[fallthrough]];
-	case ControlLevel::None:
-		if (name == "getControlLevel") {
-			json = (int)webpage_control_level;
-		}
+#if ENABLE_PAGE_AUDIO_STREAMS
+	if (name == "OutputAudio") {
+		OutputPageAudio(input_args);
+		return true;
+	}
+#endif
+
+#if BROWSER_FRONTEND_API_SUPPORT_ENABLED
+	auto handler = request_handlers.find(name);
+	if (handler != request_handlers.end() &&
+	    webpage_control_level >= handler->second.level) {
+		RequestContext ctx = {bs, browser, input_args,
+				      webpage_control_level};
+		handler->second.handle(ctx);
+		json = std::move(ctx.reply);
 	}
 #else
 	UNUSED_PARAMETER(name);
@@ -267,7 +389,7 @@ bool BrowserClient::OnProcessMessageReceived(
 
 	CefRefPtr<CefListValue> execute_args = msg->GetArgumentList();
 	execute_args->SetInt(0, input_args->GetInt(0));
-	execute_args->SetString(1, json.dump());
+	execute_args->SetString(1, json);
 
 	SendBrowserProcessMessage(browser, PID_RENDERER, msg);
 
@@ -467,6 +589,7 @@ void BrowserClient::OnAcceleratedPaint2(CefRefPtr<CefBrowser>,
 #endif
 #endif
 
+#if CHROME_VERSION_BUILD < 4103
 static speaker_layout GetSpeakerLayout(CefAudioHandler::ChannelLayout cefLayout)
 {
 	switch (cefLayout) {
@@ -497,6 +620,7 @@ static speaker_layout GetSpeakerLayout(CefAudioHandler::ChannelLayout cefLayout)
 		return SPEAKERS_UNKNOWN;
 	}
 }
+#endif
 
 #if CHROME_VERSION_BUILD >= 4103
 void BrowserClient::OnAudioStreamStarted(CefRefPtr<CefBrowser> browser,
@@ -508,6 +632,17 @@ void BrowserClient::OnAudioStreamStarted(CefRefPtr<CefBrowser> browser,
 	channel_layout = (ChannelLayout)params_.channel_layout;
 	sample_rate = params_.sample_rate;
 	frames_per_buffer = params_.frames_per_buffer;
+
+	if (!valid()) {
+		return;
+	}
+	speaker_layout speakers = bs->audio_remix.Configure(
+		channel_layout, channels, (size_t)frames_per_buffer);
+	bs->audio_buffer.Start(bs->source, speakers, (uint32_t)sample_rate);
+
+	if (bs->audio_gate.Gated())
+		obs_source_set_audio_active(bs->source, true);
+	bs->audio_gate.Reset();
 }
 
 void BrowserClient::OnAudioStreamPacket(CefRefPtr<CefBrowser> browser,
@@ -515,33 +650,61 @@ void BrowserClient::OnAudioStreamPacket(CefRefPtr<CefBrowser> browser,
 					int64_t pts)
 {
 	UNUSED_PARAMETER(browser);
-	if (!valid()) {
+	if (!valid() || !reroute_audio) {
 		return;
 	}
-	struct obs_source_audio audio = {};
-	const uint8_t **pcm = (const uint8_t **)data;
-	speaker_layout speakers = GetSpeakerLayout(channel_layout);
-	int speaker_count = get_audio_channels(speakers);
-	for (int i = 0; i < speaker_count; i++)
-		audio.data[i] = pcm[i];
-	audio.samples_per_sec = sample_rate;
-	audio.frames = frames;
-	audio.format = AUDIO_FORMAT_FLOAT_PLANAR;
-	audio.speakers = speakers;
-	audio.timestamp = (uint64_t)pts * 1000000LLU;
-	obs_source_output_audio(bs->source, &audio);
+	/* The source already faded out when it suspended, this catches a
+	 * packet that was being pushed right then */
+	bool suspended = bs->audio_suspended;
+	if (suspended != audio_suspended) {
+		audio_suspended = suspended;
+		if (suspended)
+			bs->audio_buffer.FadeOut(bs->source);
+		else
+			bs->audio_buffer.FadeIn();
+	}
+	if (suspended) {
+		return;
+	}
+
+	const float **planes = bs->audio_remix.Process(data, (size_t)frames);
+	uint64_t timestamp = (uint64_t)pts * 1000000LLU;
+
+	bool gate_changed;
+	bool output = bs->audio_gate.Process(planes, bs->audio_remix.Channels(),
+					     (size_t)frames, timestamp,
+					     gate_changed);
+	if (gate_changed) {
+		if (!output)
+			bs->audio_buffer.Flush(bs->source);
+		obs_source_set_audio_active(bs->source, output);
+	}
+	if (!output) {
+		return;
+	}
+
+	bs->audio_buffer.Push(bs->source, planes, (size_t)frames, timestamp);
 }
 
 void BrowserClient::OnAudioStreamStopped(CefRefPtr<CefBrowser> browser)
 {
 	UNUSED_PARAMETER(browser);
+	if (!valid()) {
+		return;
+	}
+	bs->audio_buffer.Flush(bs->source);
 }
 
 void BrowserClient::OnAudioStreamError(CefRefPtr<CefBrowser> browser,
 				       const CefString &message)
 {
 	UNUSED_PARAMETER(browser);
-	UNUSED_PARAMETER(message);
+	if (!valid()) {
+		return;
+	}
+	blog(LOG_WARNING, "[obs-browser]: Audio stream error: %s",
+	     message.ToString().c_str());
+	bs->audio_buffer.Flush(bs->source);
 }
 
 static CefAudioHandler::ChannelLayout Convert2CEFSpeakerLayout(int channels)
@@ -573,7 +736,9 @@ bool BrowserClient::GetAudioParameters(CefRefPtr<CefBrowser> browser,
 	int channels = (int)audio_output_get_channels(obs_get_audio());
 	params.channel_layout = Convert2CEFSpeakerLayout(channels);
 	params.sample_rate = (int)audio_output_get_sample_rate(obs_get_audio());
-	params.frames_per_buffer = kFramesPerBuffer;
+	params.frames_per_buffer = valid() && bs->audio_buffer_frames > 0
+					   ? bs->audio_buffer_frames
+					   : kFramesPerBuffer;
 	return true;
 }
 #elif CHROME_VERSION_BUILD < 4103
@@ -593,8 +758,11 @@ void BrowserClient::OnAudioStreamStarted(CefRefPtr<CefBrowser> browser, int id,
 
 		obs_source_add_active_child(bs->source, stream.source);
 
-		std::lock_guard<std::mutex> lock(bs->audio_sources_mutex);
-		bs->audio_sources.push_back(stream.source);
+		auto list = std::make_shared<AudioSourceList>();
+		if (auto sources = bs->GetAudioSources())
+			*list = *sources;
+		list->push_back(stream.source);
+		bs->PublishAudioSources(std::move(list));
 	}
 
 	stream.speakers = GetSpeakerLayout(channel_layout);
@@ -607,7 +775,7 @@ void BrowserClient::OnAudioStreamPacket(CefRefPtr<CefBrowser> browser, int id,
 					int64_t pts)
 {
 	UNUSED_PARAMETER(browser);
-	if (!valid()) {
+	if (!valid() || !reroute_audio) {
 		return;
 	}
 
@@ -640,21 +808,47 @@ void BrowserClient::OnAudioStreamStopped(CefRefPtr<CefBrowser> browser, int id)
 	}
 
 	AudioStream &stream = pair->second;
-	{
-		std::lock_guard<std::mutex> lock(bs->audio_sources_mutex);
-		for (size_t i = 0; i < bs->audio_sources.size(); i++) {
-			obs_source_t *source = bs->audio_sources[i];
-			if (source == stream.source) {
-				bs->audio_sources.erase(
-					bs->audio_sources.begin() + i);
-				break;
-			}
+
+	auto list = std::make_shared<AudioSourceList>();
+	if (auto sources = bs->GetAudioSources()) {
+		for (obs_source_t *source : *sources) {
+			if (source != stream.source)
+				list->push_back(source);
 		}
 	}
+
+	std::vector<OBSSourceAutoRelease> removed;
+	removed.push_back(std::move(stream.source));
 	bs->audio_streams.erase(pair);
+
+	bs->PublishAudioSources(std::move(list), std::move(removed));
 }
 #endif
 
+void BrowserClient::OnLoadStart(CefRefPtr<CefBrowser> browser,
+				CefRefPtr<CefFrame> frame, TransitionType)
+{
+	if (!valid()) {
+		return;
+	}
+
+	/* A navigation can move the page to a new renderer.  That one only
+	 * knows the CSS the browser was created with, which is outdated if
+	 * it was changed since, and pooled browsers aren't created with any.
+	 * The navigation has committed by now, so this reaches the renderer
+	 * that shows the new document. */
+	if (frame->IsMain())
+		SendBrowserCSS(browser, bs->css);
+
+	/* State subscriptions and video ticks belong to the page that
+	 * requested them */
+	if (frame->IsMain()) {
+		bs->state_topics = 0;
+		bs->state_sent.clear();
+		bs->video_tick = false;
+	}
+}
+
 void BrowserClient::OnLoadEnd(CefRefPtr<CefBrowser>, CefRefPtr<CefFrame> frame,
 			      int)
 {
@@ -662,19 +856,16 @@ void BrowserClient::OnLoadEnd(CefRefPtr<CefBrowser>, CefRefPtr<CefFrame> frame,
 		return;
 	}
 
-	if (frame->IsMain() && bs->css.length()) {
-		std::string uriEncodedCSS =
-			CefURIEncode(bs->css, false).ToString();
-
-		std::string script;
-		script += "const obsCSS = document.createElement('style');";
-		script += "obsCSS.appendChild(document.createTextNode("
-			  "decodeURIComponent(\"" +
-			  uriEncodedCSS + "\")));";
-		script += "document.querySelector('head').appendChild(obsCSS);";
+	if (frame->IsMain())
+		bs->FinishLoading(true);
+}
 
-		frame->ExecuteJavaScript(script, "", 0);
-	}
+void BrowserClient::OnLoadError(CefRefPtr<CefBrowser>,
+				CefRefPtr<CefFrame> frame, ErrorCode,
+				const CefString &, const CefString &)
+{
+	if (valid() && frame->IsMain())
+		bs->FinishLoading(false);
 }
 
 bool BrowserClient::OnConsoleMessage(CefRefPtr<CefBrowser>,
@@ -38,15 +38,23 @@ class BrowserClient : public CefClient,
 		      public CefLoadHandler {
 
 	bool sharing_available = false;
-	bool reroute_audio = true;
+	std::atomic<bool> reroute_audio = true;
 	ControlLevel webpage_control_level = DEFAULT_CONTROL_LEVEL;
 
 	inline bool valid() const;
+#if ENABLE_PAGE_AUDIO_STREAMS
+	void OutputPageAudio(CefRefPtr<CefListValue> args);
+#endif
 
 	void UpdateExtraTexture();
 
 public:
 	BrowserSource *bs;
+	/* Created for the browser pool, see AddPooledBrowser */
+	bool pooled = false;
+	/* Pages of this browser reading obsstudio.sharedData, only used on
+	 * the CEF UI thread */
+	int shared_data_reads = 0;
 	CefRect popupRect;
 	CefRect originalPopupRect;
 
@@ -55,6 +63,7 @@ public:
 	int channels;
 	ChannelLayout channel_layout;
 	int frames_per_buffer;
+	bool audio_suspended = false;
 #endif
 	inline BrowserClient(BrowserSource *bs_, bool sharing_avail,
 			     bool reroute_audio_,
@@ -66,6 +75,31 @@ public:
 	{
 	}
 
+	/* Hands a pooled browser's client over to a source */
+	inline void Adopt(BrowserSource *bs_, bool sharing_avail,
+			  bool reroute_audio_,
+			  ControlLevel webpage_control_level_)
+	{
+		sharing_available = sharing_avail;
+		reroute_audio = reroute_audio_;
+		webpage_control_level = webpage_control_level_;
+		pooled = false;
+		bs = bs_;
+	}
+
+	/* Whether the browser was created to paint into a shared texture */
+	inline bool SharingAvailable() const { return sharing_available; }
+
+	/* Applied to a running browser by BrowserSource::UpdateInPlace */
+	inline void SetRerouteAudio(bool reroute_audio_)
+	{
+		reroute_audio = reroute_audio_;
+	}
+	inline void SetControlLevel(ControlLevel webpage_control_level_)
+	{
+		webpage_control_level = webpage_control_level_;
+	}
+
 	/* CefClient */
 	virtual CefRefPtr<CefLoadHandler> GetLoadHandler() override;
 	virtual CefRefPtr<CefRenderHandler> GetRenderHandler() override;
@@ -104,6 +138,8 @@ public:
 		      CefBrowserSettings &settings,
 		      CefRefPtr<CefDictionaryValue> &extra_info,
 		      bool *no_javascript_access) override;
+	virtual void OnAfterCreated(CefRefPtr<CefBrowser> browser) override;
+	virtual void OnBeforeClose(CefRefPtr<CefBrowser> browser) override;
 #if CHROME_VERSION_BUILD >= 4638
 	/* CefRequestHandler */
 	virtual CefRefPtr<CefResourceRequestHandler> GetResourceRequestHandler(
@@ -179,9 +215,16 @@ public:
 					  int frames_per_buffer) override;
 #endif
 	/* CefLoadHandler */
+	virtual void OnLoadStart(CefRefPtr<CefBrowser> browser,
+				 CefRefPtr<CefFrame> frame,
+				 TransitionType transition_type) override;
 	virtual void OnLoadEnd(CefRefPtr<CefBrowser> browser,
 			       CefRefPtr<CefFrame> frame,
 			       int httpStatusCode) override;
+	virtual void OnLoadError(CefRefPtr<CefBrowser> browser,
+				 CefRefPtr<CefFrame> frame, ErrorCode errorCode,
+				 const CefString &errorText,
+				 const CefString &failedUrl) override;
 
 	IMPLEMENT_REFCOUNTING(BrowserClient);
 };
@@ -0,0 +1,161 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "browser-shared-data.hpp"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Shared between the plugin and the helper processes, so this must not
+ * depend on libobs.
+ *
+ * Readers map the block shared and read-only, so they always see the
+ * plugin's latest writes and can never change the block for anyone else. */
+
+#ifdef _WIN32
+bool SharedMemory::Create(const std::string &name_, size_t size_)
+{
+	Close();
+
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr,
+					    PAGE_READWRITE, 0, (DWORD)size_,
+					    name_.c_str());
+	if (!mapping)
+		return false;
+
+	void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size_);
+	if (!view) {
+		CloseHandle(mapping);
+		return false;
+	}
+
+	memset(view, 0, size_);
+	handle = mapping;
+	data = view;
+	size = size_;
+	name = name_;
+	owner = true;
+	return true;
+}
+
+bool SharedMemory::Open(const std::string &name_, size_t size_)
+{
+	Close();
+
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name_.c_str());
+	if (!mapping)
+		return false;
+
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size_);
+	if (!view) {
+		CloseHandle(mapping);
+		return false;
+	}
+
+	handle = mapping;
+	data = view;
+	size = size_;
+	name = name_;
+	return true;
+}
+
+void SharedMemory::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (handle)
+		CloseHandle((HANDLE)handle);
+
+	handle = nullptr;
+	data = nullptr;
+	size = 0;
+	owner = false;
+}
+#else
+bool SharedMemory::Create(const std::string &name_, size_t size_)
+{
+	Close();
+
+	/* A stale block of a crashed process would have the same name */
+	shm_unlink(name_.c_str());
+
+	int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd == -1)
+		return false;
+
+	if (ftruncate(fd, (off_t)size_) != 0) {
+		close(fd);
+		shm_unlink(name_.c_str());
+		return false;
+	}
+
+	void *view = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+			  fd, 0);
+	close(fd);
+
+	if (view == MAP_FAILED) {
+		shm_unlink(name_.c_str());
+		return false;
+	}
+
+	data = view;
+	size = size_;
+	name = name_;
+	owner = true;
+	return true;
+}
+
+bool SharedMemory::Open(const std::string &name_, size_t size_)
+{
+	Close();
+
+	int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+	if (fd == -1)
+		return false;
+
+	void *view = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (view == MAP_FAILED)
+		return false;
+
+	data = view;
+	size = size_;
+	name = name_;
+	return true;
+}
+
+void SharedMemory::Close()
+{
+	if (data)
+		munmap(data, size);
+	if (owner)
+		shm_unlink(name.c_str());
+
+	data = nullptr;
+	size = 0;
+	owner = false;
+}
+#endif
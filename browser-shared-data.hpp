@@ -0,0 +1,103 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* Layout of the shared memory block that the plugin publishes once per
+ * video frame, and that render processes expose to pages as
+ * obsstudio.sharedData.  Everything is little-endian with natural
+ * alignment, so pages can read it with a DataView.
+ *
+ * Records form a ring that is written in order.  A record is consistent if
+ * its sequence is even and unchanged after reading it.  Render processes map
+ * the block read-only. */
+#define SHARED_DATA_MAGIC 0x4453424F /* "OBSD" */
+#define SHARED_DATA_VERSION 1
+#define SHARED_DATA_RECORDS 16
+#define SHARED_DATA_MIXES 6
+#define SHARED_DATA_CHANNELS 8
+#define SHARED_DATA_SWITCH "obs-shared-data"
+
+struct SharedDataRecord {
+	std::atomic<uint32_t> sequence;
+	uint32_t reserved;
+	uint64_t frame;
+	uint64_t video_time_ns;
+	/* Linear peak of each output mix and channel since the last record */
+	float mix_peaks[SHARED_DATA_MIXES][SHARED_DATA_CHANNELS];
+};
+
+struct SharedDataHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t record_size;
+	uint32_t record_count;
+	/* Index of the most recently completed record */
+	std::atomic<uint32_t> latest;
+	uint32_t mix_count;
+	uint32_t channel_count;
+};
+
+struct SharedData {
+	SharedDataHeader header;
+	SharedDataRecord records[SHARED_DATA_RECORDS];
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+		      std::atomic<uint32_t>::is_always_lock_free,
+	      "shared data atomics must have the layout of a plain uint32_t");
+
+class SharedMemory {
+	void *handle = nullptr;
+	void *data = nullptr;
+	size_t size = 0;
+	std::string name;
+	bool owner = false;
+
+public:
+	inline ~SharedMemory() { Close(); }
+
+	bool Create(const std::string &name, size_t size);
+	bool Open(const std::string &name, size_t size);
+	void Close();
+
+	inline void *Get() const { return data; }
+	inline size_t Size() const { return size; }
+};
+
+/* obs-browser-shared-data.cpp, plugin only */
+std::string StartSharedData();
+void StopSharedData();
+
+/* Counts browsers whose pages read the block, which is only updated while
+ * there are any */
+void AddSharedDataReader();
+void RemoveSharedDataReader();
+
+/* Picks up the mixes the current outputs use, from the UI thread */
+void UpdateSharedDataMixes();
+
+/* Index of the OBS video frame at frame_time, as counted by the video clock.
+ * Both the records and obsstudio.onVideoTick use it, so pages can match
+ * them up. */
+uint64_t GetVideoFrameIndex(uint64_t frame_time);
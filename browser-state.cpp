@@ -0,0 +1,338 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "browser-state.hpp"
+
+#include <obs.hpp>
+#include <mutex>
+#include <nlohmann/json.hpp>
+
+#if BROWSER_FRONTEND_API_SUPPORT_ENABLED
+#include <obs-frontend-api.h>
+
+using namespace std;
+
+static nlohmann::json GetStatus()
+{
+	return {{"recording", obs_frontend_recording_active()},
+		{"streaming", obs_frontend_streaming_active()},
+		{"recordingPaused", obs_frontend_recording_paused()},
+		{"replaybuffer", obs_frontend_replay_buffer_active()},
+		{"virtualcam", obs_frontend_virtualcam_active()}};
+}
+
+static nlohmann::json GetCurrentScene()
+{
+	OBSSourceAutoRelease current_scene = obs_frontend_get_current_scene();
+	const char *name = obs_source_get_name(current_scene);
+	if (!name)
+		return nullptr;
+
+	return {{"name", name},
+		{"width", obs_source_get_width(current_scene)},
+		{"height", obs_source_get_height(current_scene)}};
+}
+
+static nlohmann::json GetSourceNames(obs_frontend_source_list &list)
+{
+	std::vector<nlohmann::json> names;
+	for (size_t i = 0; i < list.sources.num; i++)
+		names.push_back(obs_source_get_name(list.sources.array[i]));
+	obs_frontend_source_list_free(&list);
+	return names;
+}
+
+static nlohmann::json GetScenes()
+{
+	struct obs_frontend_source_list list = {};
+	obs_frontend_get_scenes(&list);
+	return GetSourceNames(list);
+}
+
+static nlohmann::json GetCurrentTransition()
+{
+	OBSSourceAutoRelease source = obs_frontend_get_current_transition();
+	const char *name = obs_source_get_name(source);
+	return name ? nlohmann::json(name) : nlohmann::json(nullptr);
+}
+
+static nlohmann::json GetTransitions()
+{
+	struct obs_frontend_source_list list = {};
+	obs_frontend_get_transitions(&list);
+	return GetSourceNames(list);
+}
+
+struct StateTopicInfo {
+	StateTopic topic;
+	const char *name;
+	ControlLevel level;
+	bool cached;
+	nlohmann::json (*get)();
+};
+
+/* Output status has no single event that covers every change, and the
+ * current scene's size follows the canvas, which can be resized without a
+ * frontend event.  Both are cheap to query, so they are always read fresh.
+ * The lists and the current transition are cached until a frontend event
+ * invalidates them. */
+static const StateTopicInfo state_topics[] = {
+	{STATE_STATUS, "status", ControlLevel::ReadObs, false, GetStatus},
+	{STATE_CURRENT_SCENE, "currentScene", ControlLevel::ReadUser, false,
+	 GetCurrentScene},
+	{STATE_SCENES, "scenes", ControlLevel::ReadUser, true, GetScenes},
+	{STATE_CURRENT_TRANSITION, "currentTransition", ControlLevel::ReadUser,
+	 true, GetCurrentTransition},
+	{STATE_TRANSITIONS, "transitions", ControlLevel::ReadUser, true,
+	 GetTransitions},
+};
+
+#define STATE_TOPIC_COUNT (sizeof(state_topics) / sizeof(state_topics[0]))
+
+struct CachedState {
+	string json;
+	uint64_t generation = 0;
+	bool valid = false;
+};
+
+static mutex cache_mutex;
+static CachedState cached_state[STATE_TOPIC_COUNT];
+
+static size_t GetStateTopicIndex(StateTopic topic)
+{
+	for (size_t i = 0; i < STATE_TOPIC_COUNT; i++) {
+		if (state_topics[i].topic == topic)
+			return i;
+	}
+	return 0;
+}
+
+string GetStateJson(StateTopic topic)
+{
+	size_t i = GetStateTopicIndex(topic);
+	const StateTopicInfo &info = state_topics[i];
+	if (!info.cached)
+		return info.get().dump();
+
+	uint64_t generation;
+	{
+		lock_guard<mutex> lock(cache_mutex);
+		if (cached_state[i].valid)
+			return cached_state[i].json;
+		generation = cached_state[i].generation;
+	}
+
+	/* Built without holding the lock.  If the topic was invalidated in
+	 * the meantime the result may already be stale, so it is returned
+	 * but not stored. */
+	string json = info.get().dump();
+
+	lock_guard<mutex> lock(cache_mutex);
+	if (cached_state[i].generation == generation) {
+		cached_state[i].json = json;
+		cached_state[i].valid = true;
+	}
+	return json;
+}
+
+void InvalidateState(uint32_t topics)
+{
+	lock_guard<mutex> lock(cache_mutex);
+	for (size_t i = 0; i < STATE_TOPIC_COUNT; i++) {
+		if (topics & state_topics[i].topic) {
+			cached_state[i].valid = false;
+			cached_state[i].generation++;
+		}
+	}
+}
+
+string GetStateSnapshot(ControlLevel level)
+{
+	/* The topic values are already JSON, so they are spliced in as-is
+	 * instead of being parsed again */
+	string json = "{\"controlLevel\":" + to_string((int)level);
+
+	for (auto &info : state_topics) {
+		if (level < info.level)
+			continue;
+
+		json += ",\"";
+		json += info.name;
+		json += "\":";
+		json += GetStateJson(info.topic);
+	}
+
+	json += "}";
+	return json;
+}
+
+static uint32_t GetStateTopic(const string &name)
+{
+	for (auto &info : state_topics) {
+		if (name == info.name)
+			return info.topic;
+	}
+	return 0;
+}
+
+uint32_t GetStateTopics(CefRefPtr<CefListValue> args, size_t idx)
+{
+	uint32_t topics = 0;
+
+	for (size_t i = idx; i < args->GetSize(); i++) {
+		if (args->GetType(i) == VTYPE_STRING) {
+			topics |= GetStateTopic(args->GetString(i).ToString());
+
+		} else if (args->GetType(i) == VTYPE_LIST) {
+			CefRefPtr<CefListValue> list = args->GetList(i);
+			for (size_t j = 0; j < list->GetSize(); j++) {
+				if (list->GetType(j) == VTYPE_STRING)
+					topics |= GetStateTopic(
+						list->GetString(j).ToString());
+			}
+		}
+	}
+
+	return topics;
+}
+
+uint32_t GetAllowedStateTopics(ControlLevel level)
+{
+	uint32_t topics = 0;
+	for (auto &info : state_topics) {
+		if (level >= info.level)
+			topics |= info.topic;
+	}
+	return topics;
+}
+
+vector<string> GetStateTopicNames(uint32_t topics)
+{
+	vector<string> names;
+	for (auto &info : state_topics) {
+		if (topics & info.topic)
+			names.push_back(info.name);
+	}
+	return names;
+}
+
+void SubscribeState(BrowserSource *bs, CefRefPtr<CefBrowser> browser,
+		    uint32_t topics)
+{
+	bs->state_topics = topics;
+	bs->state_sent.assign(STATE_TOPIC_COUNT, string());
+
+	if (!topics)
+		return;
+
+	CefRefPtr<CefProcessMessage> msg =
+		CefProcessMessage::Create("StateUpdate");
+	CefRefPtr<CefListValue> args = msg->GetArgumentList();
+
+	size_t idx = 0;
+	for (size_t i = 0; i < STATE_TOPIC_COUNT; i++) {
+		const StateTopicInfo &info = state_topics[i];
+		if ((topics & info.topic) == 0)
+			continue;
+
+		bs->state_sent[i] = GetStateJson(info.topic);
+		args->SetString(idx++, info.name);
+		args->SetString(idx++, bs->state_sent[i]);
+	}
+
+	SendBrowserProcessMessage(browser, PID_RENDERER, msg);
+}
+
+void SendStateUpdate(BrowserSource *bs, CefRefPtr<CefBrowser> browser,
+		     const vector<StateValue> &values)
+{
+	uint32_t topics = bs->state_topics;
+	if (!topics)
+		return;
+
+	CefRefPtr<CefProcessMessage> msg;
+	CefRefPtr<CefListValue> args;
+	size_t idx = 0;
+
+	for (auto &value : values) {
+		size_t i = GetStateTopicIndex(value.topic);
+		if ((topics & value.topic) == 0 || i >= bs->state_sent.size())
+			continue;
+		if (bs->state_sent[i] == value.json)
+			continue;
+
+		if (!msg) {
+			msg = CefProcessMessage::Create("StateUpdate");
+			args = msg->GetArgumentList();
+		}
+		bs->state_sent[i] = value.json;
+		args->SetString(idx++, value.name);
+		args->SetString(idx++, value.json);
+	}
+
+	if (!msg)
+		return;
+
+	SendBrowserProcessMessage(browser, PID_RENDERER, msg);
+}
+
+void RestrictState(BrowserSource *bs, CefRefPtr<CefBrowser> browser,
+		   ControlLevel level)
+{
+	uint32_t allowed = GetAllowedStateTopics(level);
+	bs->state_topics &= allowed;
+
+	/* The renderer may also hold values of topics the page subscribed
+	 * to before, so every topic the level doesn't allow is dropped */
+	uint32_t revoked = STATE_ALL & ~allowed;
+	if (!revoked)
+		return;
+
+	CefRefPtr<CefProcessMessage> msg =
+		CefProcessMessage::Create("StateRevoke");
+	CefRefPtr<CefListValue> args = msg->GetArgumentList();
+
+	size_t idx = 0;
+	for (auto &info : state_topics) {
+		if (revoked & info.topic)
+			args->SetString(idx++, info.name);
+	}
+
+	SendBrowserProcessMessage(browser, PID_RENDERER, msg);
+}
+
+void UpdateState(uint32_t topics)
+{
+	InvalidateState(topics);
+
+	/* State is not rebuilt at all while no page is subscribed */
+	topics &= GetSubscribedStateTopics();
+	if (!topics)
+		return;
+
+	vector<StateValue> values;
+	for (auto &info : state_topics) {
+		if ((topics & info.topic) == 0)
+			continue;
+
+		values.push_back(
+			{info.topic, info.name, GetStateJson(info.topic)});
+	}
+
+	DispatchStateUpdate(values);
+}
+#endif
@@ -0,0 +1,83 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cef-headers.hpp"
+#include "obs-browser-source.hpp"
+
+/* OBS state that pages can subscribe to with obsstudio.subscribe().  Once
+ * subscribed, a browser is pushed the new value of a topic whenever it
+ * changes.  For the topics that only change with a frontend event, the
+ * renderer serves the matching get* calls from its cache instead of doing a
+ * round trip to the browser process. */
+enum StateTopic : uint32_t {
+	STATE_STATUS = 1 << 0,
+	STATE_CURRENT_SCENE = 1 << 1,
+	STATE_SCENES = 1 << 2,
+	STATE_CURRENT_TRANSITION = 1 << 3,
+	STATE_TRANSITIONS = 1 << 4,
+
+	STATE_ALL = (1 << 5) - 1,
+};
+
+struct StateValue {
+	StateTopic topic;
+	const char *name;
+	std::string json;
+};
+
+uint32_t GetStateTopics(CefRefPtr<CefListValue> args, size_t idx);
+uint32_t GetAllowedStateTopics(ControlLevel level);
+std::vector<std::string> GetStateTopicNames(uint32_t topics);
+
+/* Called from the CEF UI thread when a page subscribes.  The current values
+ * are sent before the subscription is replied to, so the page's cache is
+ * already filled when its callback runs. */
+void SubscribeState(BrowserSource *bs, CefRefPtr<CefBrowser> browser,
+		    uint32_t topics);
+
+/* Called from the CEF UI thread.  Sends the values of the topics the page
+ * is subscribed to right now, skipping the ones it was already sent. */
+void SendStateUpdate(BrowserSource *bs, CefRefPtr<CefBrowser> browser,
+		     const std::vector<StateValue> &values);
+
+/* Called from the CEF UI thread when a browser's control level changes.
+ * Drops the subscriptions the new level no longer allows and tells the
+ * renderer to forget its cached values of those topics. */
+void RestrictState(BrowserSource *bs, CefRefPtr<CefBrowser> browser,
+		   ControlLevel level);
+
+/* Returns the JSON of a topic, served from a cache that is kept until
+ * the topic is invalidated by a frontend event */
+std::string GetStateJson(StateTopic topic);
+void InvalidateState(uint32_t topics);
+
+/* Everything the control level allows reading, as a single JSON object
+ * keyed by topic name, plus the control level itself */
+std::string GetStateSnapshot(ControlLevel level);
+
+/* Invalidates the given topics and pushes the ones that changed */
+void UpdateState(uint32_t topics);
+
+/* obs-browser-source.cpp */
+uint32_t GetSubscribedStateTopics();
+void DispatchStateUpdate(const std::vector<StateValue> &values);
@@ -47,6 +47,14 @@
 #define ENABLE_WASHIDDEN 0
 #endif
 
+/* Pages hand audio over as ArrayBuffers, which CEF only gives access to
+ * from this version on */
+#if CHROME_VERSION_BUILD >= 6045
+#define ENABLE_PAGE_AUDIO_STREAMS 1
+#else
+#define ENABLE_PAGE_AUDIO_STREAMS 0
+#endif
+
 #define SendBrowserProcessMessage(browser, pid, msg)             \
 	CefRefPtr<CefFrame> mainFrame = browser->GetMainFrame(); \
 	if (mainFrame) {                                         \
@@ -22,8 +22,10 @@ endif()
 
 option(ENABLE_BROWSER_PANELS "Enable Qt web browser panel support" ON)
 option(ENABLE_BROWSER_QT_LOOP "Enable running CEF on the main UI thread alongside Qt" ${OS_MACOS})
+option(ENABLE_BROWSER_TESTS "Build browser source tests and benchmarks" OFF)
 
-mark_as_advanced(ENABLE_BROWSER_LEGACY ENABLE_BROWSER_SHARED_TEXTURE ENABLE_BROWSER_PANELS ENABLE_BROWSER_QT_LOOP)
+mark_as_advanced(ENABLE_BROWSER_LEGACY ENABLE_BROWSER_SHARED_TEXTURE ENABLE_BROWSER_PANELS ENABLE_BROWSER_QT_LOOP
+                 ENABLE_BROWSER_TESTS)
 
 find_package(CEF REQUIRED 95)
 
@@ -54,15 +56,25 @@ configure_file(${CMAKE_CURRENT_SOURCE_DIR}/browser-config.h.in ${CMAKE_BINARY_DI
 target_sources(
   obs-browser
   PRIVATE obs-browser-plugin.cpp
+          obs-browser-shared-data.cpp
           obs-browser-source.cpp
           obs-browser-source.hpp
           obs-browser-source-audio.cpp
           browser-app.cpp
           browser-app.hpp
+          browser-audio-buffer.cpp
+          browser-audio-buffer.hpp
+          browser-audio-mix.hpp
+          browser-audio-remix.cpp
+          browser-audio-remix.hpp
           browser-client.cpp
           browser-client.hpp
           browser-scheme.cpp
           browser-scheme.hpp
+          browser-shared-data.cpp
+          browser-shared-data.hpp
+          browser-state.cpp
+          browser-state.hpp
           browser-version.h
           cef-headers.hpp
           deps/base64/base64.cpp
@@ -96,7 +108,7 @@ if(NOT OS_MACOS OR ENABLE_BROWSER_LEGACY)
   add_executable(obs-browser-page)
 
   target_sources(obs-browser-page PRIVATE cef-headers.hpp obs-browser-page/obs-browser-page-main.cpp browser-app.cpp
-                                          browser-app.hpp)
+                                          browser-app.hpp browser-shared-data.cpp browser-shared-data.hpp)
 
   target_link_libraries(obs-browser-page PRIVATE CEF::Library nlohmann_json::nlohmann_json)
 
@@ -193,8 +205,8 @@ elseif(OS_MACOS)
 
     add_executable(${_HELPER_TARGET} MACOSX_BUNDLE)
     add_executable(OBS::browser-helper${_TARGET_SUFFIX} ALIAS ${_HELPER_TARGET})
-    target_sources(${_HELPER_TARGET} PRIVATE browser-app.cpp browser-app.hpp obs-browser-page/obs-browser-page-main.cpp
-                                             cef-headers.hpp)
+    target_sources(${_HELPER_TARGET} PRIVATE browser-app.cpp browser-app.hpp browser-shared-data.cpp browser-shared-data.hpp
+                                             obs-browser-page/obs-browser-page-main.cpp cef-headers.hpp)
 
     target_link_libraries(${_HELPER_TARGET} PRIVATE CEF::Wrapper nlohmann_json::nlohmann_json)
 
@@ -220,7 +232,8 @@ elseif(OS_MACOS)
 elseif(OS_POSIX)
   find_package(X11 REQUIRED)
 
-  target_link_libraries(obs-browser PRIVATE CEF::Wrapper CEF::Library X11::X11)
+  target_link_libraries(obs-browser PRIVATE CEF::Wrapper CEF::Library X11::X11 rt)
+  target_link_libraries(obs-browser-page PRIVATE rt)
 
   get_target_property(_CEF_DIRECTORY CEF::Library INTERFACE_LINK_DIRECTORIES)
 
@@ -259,3 +272,7 @@ endif()
 set_target_properties(obs-browser PROPERTIES FOLDER "plugins/obs-browser" PREFIX "")
 
 setup_plugin_target(obs-browser)
+
+if(ENABLE_BROWSER_TESTS)
+  add_subdirectory(test)
+endif()
@@ -1,6 +1,6 @@
 find_package(X11 REQUIRED)
 
-target_link_libraries(obs-browser PRIVATE CEF::Wrapper CEF::Library X11::X11)
+target_link_libraries(obs-browser PRIVATE CEF::Wrapper CEF::Library X11::X11 rt)
 set_target_properties(obs-browser PROPERTIES BUILD_RPATH "$ORIGIN/" INSTALL_RPATH "$ORIGIN/")
 
 add_executable(browser-helper)
@@ -8,12 +8,17 @@ add_executable(OBS::browser-helper ALIAS browser-helper)
 
 target_sources(
   browser-helper PRIVATE # cmake-format: sortable
-                         browser-app.cpp browser-app.hpp cef-headers.hpp obs-browser-page/obs-browser-page-main.cpp)
+                         browser-app.cpp
+                         browser-app.hpp
+                         browser-shared-data.cpp
+                         browser-shared-data.hpp
+                         cef-headers.hpp
+                         obs-browser-page/obs-browser-page-main.cpp)
 
 target_include_directories(browser-helper PRIVATE "${CMAKE_CURRENT_SOURCE_DIR}/deps"
                                                   "${CMAKE_CURRENT_SOURCE_DIR}/obs-browser-page")
 
-target_link_libraries(browser-helper PRIVATE CEF::Wrapper CEF::Library)
+target_link_libraries(browser-helper PRIVATE CEF::Wrapper CEF::Library rt)
 
 set(OBS_EXECUTABLE_DESTINATION "${OBS_PLUGIN_DESTINATION}")
 
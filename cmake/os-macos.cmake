@@ -31,7 +31,14 @@ foreach(helper IN LISTS helper_suffixes)
 
   target_sources(
     ${target_name} PRIVATE # cmake-format: sortable
-                           browser-app.cpp browser-app.hpp browser-mac.mm browser-mac.h cef-headers.hpp obs-browser-page/obs-browser-page-main.cpp)
+                           browser-app.cpp
+                           browser-app.hpp
+                           browser-mac.mm
+                           browser-mac.h
+                           browser-shared-data.cpp
+                           browser-shared-data.hpp
+                           cef-headers.hpp
+                           obs-browser-page/obs-browser-page-main.cpp)
 
   target_compile_definitions(${target_name} PRIVATE ENABLE_BROWSER_SHARED_TEXTURE)
 
@@ -22,6 +22,7 @@
 #include <util/dstr.hpp>
 #include <obs-module.h>
 #include <obs.hpp>
+#include <atomic>
 #include <functional>
 #include <sstream>
 #include <thread>
@@ -31,6 +32,8 @@
 #include "obs-browser-source.hpp"
 #include "browser-scheme.hpp"
 #include "browser-app.hpp"
+#include "browser-shared-data.hpp"
+#include "browser-state.hpp"
 #include "browser-version.h"
 
 #include "obs-websocket-api/obs-websocket-api.h"
@@ -72,6 +75,11 @@ static thread manager_thread;
 static bool manager_initialized = false;
 os_event_t *cef_started_event = nullptr;
 
+/* Start CEF at post_load instead of with the first browser, see
+ * obs_module_post_load */
+static bool init_at_startup = false;
+static uint64_t init_requested = 0;
+
 #if defined(_WIN32)
 static int adapterCount = 0;
 #endif
@@ -140,11 +148,16 @@ static void browser_source_get_defaults(obs_data_t *settings)
 	obs_data_set_default_bool(settings, "fps_custom", true);
 #endif
 	obs_data_set_default_bool(settings, "shutdown", false);
+	obs_data_set_default_bool(settings, "freeze", false);
 	obs_data_set_default_bool(settings, "is_media_flag", false);
 	obs_data_set_default_bool(settings, "restart_when_active", false);
 	obs_data_set_default_int(settings, "webpage_control_level",
 				 (int)DEFAULT_CONTROL_LEVEL);
 	obs_data_set_default_string(settings, "css", default_css);
+	obs_data_set_default_int(settings, "audio_buffer_frames", 1024);
+	obs_data_set_default_int(settings, "audio_silence_hold", 0);
+	obs_data_set_default_int(settings, "audio_suspend_mode",
+				 (int)AudioSuspendMode::Never);
 
 #ifdef __APPLE__
 	obs_data_set_default_bool(settings, "reroute_audio", true);
@@ -224,6 +237,39 @@ static obs_properties_t *browser_source_get_properties(void *data)
 	obs_properties_add_bool(props, "reroute_audio",
 				obs_module_text("RerouteAudioStreamlabs"));
 
+#if CHROME_VERSION_BUILD >= 4103
+	/* Smaller buffers lower the latency of page audio, at the cost of
+	 * more packets for CEF and OBS to handle */
+	obs_property_t *bufferSize = obs_properties_add_list(
+		props, "audio_buffer_frames",
+		obs_module_text("AudioBufferSize"), OBS_COMBO_TYPE_LIST,
+		OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(bufferSize, "128", 128);
+	obs_property_list_add_int(bufferSize, "256", 256);
+	obs_property_list_add_int(bufferSize, "512", 512);
+	obs_property_list_add_int(bufferSize, "1024", 1024);
+
+	/* 0 keeps outputting silence, as before */
+	obs_property_t *silenceHold = obs_properties_add_int(
+		props, "audio_silence_hold",
+		obs_module_text("AudioSilenceHold"), 0, 60000, 100);
+	obs_property_int_set_suffix(silenceHold, " ms");
+
+	obs_property_t *suspendMode = obs_properties_add_list(
+		props, "audio_suspend_mode",
+		obs_module_text("AudioSuspendMode"), OBS_COMBO_TYPE_LIST,
+		OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(suspendMode,
+				  obs_module_text("AudioSuspendMode.Never"),
+				  (int)AudioSuspendMode::Never);
+	obs_property_list_add_int(suspendMode,
+				  obs_module_text("AudioSuspendMode.Hidden"),
+				  (int)AudioSuspendMode::Hidden);
+	obs_property_list_add_int(suspendMode,
+				  obs_module_text("AudioSuspendMode.Inactive"),
+				  (int)AudioSuspendMode::Inactive);
+#endif
+
 	obs_property_t *fps_set = obs_properties_add_bool(
 		props, "fps_custom", obs_module_text("CustomFrameRate"));
 	obs_property_set_modified_callback(fps_set, is_fps_custom);
@@ -239,6 +285,11 @@ static obs_properties_t *browser_source_get_properties(void *data)
 	obs_property_text_set_monospace(p, true);
 	obs_properties_add_bool(props, "shutdown",
 				obs_module_text("ShutdownSourceNotVisible"));
+#if ENABLE_WASHIDDEN
+	/* Shutting down takes precedence */
+	obs_properties_add_bool(props, "freeze",
+				obs_module_text("FreezeSourceNotVisible"));
+#endif
 	obs_properties_add_bool(props, "restart_when_active",
 				obs_module_text("RefreshBrowserActive"));
 
@@ -324,12 +375,22 @@ static obs_missing_files_t *browser_source_missingfiles(void *data)
 
 static CefRefPtr<BrowserApp> app;
 
+/* Called on the CEF UI thread right before each browser is created, so
+ * the flags are queued in the order their renderers are launched */
+void AddMediaFlag(bool enabled)
+{
+	if (app)
+		app->AddFlag(enabled);
+}
+
 static void BrowserInit(obs_data_t *settings_obs)
 {
 	UNUSED_PARAMETER(settings_obs);
 #if defined(__APPLE__) && defined(USE_UI_LOOP)
 	ExecuteTask([settings_obs]() {
 #endif
+		uint64_t init_start = os_gettime_ns();
+
 		string path = obs_get_module_binary_path(obs_current_module());
 		path = path.substr(0, path.find_last_of('/') + 1);
 		path += "//obs-browser-page";
@@ -434,6 +495,9 @@ static void BrowserInit(obs_data_t *settings_obs)
 #endif
 
 		app = new BrowserApp(tex_sharing_avail);
+		app->shared_data_name = StartSharedData();
+
+		uint64_t cef_start = os_gettime_ns();
 
 #ifdef _WIN32
 		CefExecuteProcess(args, app, nullptr);
@@ -462,7 +526,16 @@ static void BrowserInit(obs_data_t *settings_obs)
 		CefRegisterSchemeHandlerFactory(
 			"http", "absolute", new BrowserSchemeHandlerFactory());
 #endif
+		uint64_t cef_end = os_gettime_ns();
 		os_event_signal(cef_started_event);
+
+		blog(LOG_INFO,
+		     "[obs-browser]: CEF started %s: waited %d ms, "
+		     "setup %d ms, CefInitialize %d ms",
+		     init_at_startup ? "at startup" : "for the first browser",
+		     (int)((init_start - init_requested) / 1000000ULL),
+		     (int)((cef_start - init_start) / 1000000ULL),
+		     (int)((cef_end - cef_start) / 1000000ULL));
 #if defined(__APPLE__) && defined(USE_UI_LOOP)
 	});
 #endif
@@ -503,6 +576,7 @@ static void BrowserManagerThread(obs_data_t *settings)
 extern "C" EXPORT void obs_browser_initialize(obs_data_t *settings)
 {
 	if (!os_atomic_set_bool(&manager_initialized, true)) {
+		init_requested = os_gettime_ns();
 #ifdef ENABLE_BROWSER_QT_LOOP
 		BrowserInit(settings);
 #else
@@ -533,11 +607,6 @@ void RegisterBrowserSource()
 		     settings, source);
 
 		obs_browser_initialize(settings);
-		if (manager_initialized && app) {
-			bool enabled =
-				obs_data_get_bool(settings, "is_media_flag");
-			app->AddFlag(enabled);
-		}
 
 		obs_source_set_audio_mixers(source, 0xFF);
 		obs_source_set_monitoring_type(
@@ -553,11 +622,6 @@ void RegisterBrowserSource()
 	info.missing_files = browser_source_missingfiles;
 	info.update = [](void *data, obs_data_t *settings) {
 		BrowserSource *bs = static_cast<BrowserSource *>(data);
-		if (app) {
-			bool enabled =
-				obs_data_get_bool(settings, "is_media_flag");
-			app->media_flag = enabled ? 1 : 0;
-		}
 		bs->Update(settings);
 	};
 	info.get_width = [](void *data) {
@@ -630,10 +694,198 @@ void RegisterBrowserSource()
 
 extern void DispatchJSEvent(std::string eventName, std::string jsonString,
 			    BrowserSource *browser = nullptr);
+extern void DispatchJSEvents(
+	const std::vector<std::pair<std::string, std::string>> &events,
+	BrowserSource *browser = nullptr);
 
 #if BROWSER_FRONTEND_API_SUPPORT_ENABLED
+/* Scene and transition list changes only describe the latest state, and OBS
+ * fires them in bursts while a scene collection loads or while scenes are
+ * edited in bulk.  They are merged here and flushed on the UI thread once
+ * the coalescing window has passed, so each browser only receives the most
+ * recent list. */
+#define EVENT_COALESCE_WINDOW_NS 50000000ULL
+
+enum : uint32_t {
+	COALESCED_SCENE_LIST = 1 << 0,
+	COALESCED_TRANSITION_LIST = 1 << 1,
+};
+
+/* The pending events and the time the first of them arrived are only
+ * changed together */
+static std::mutex coalesced_mutex;
+static uint32_t coalesced_events = 0;
+static uint64_t coalesced_since = 0;
+static std::atomic<bool> coalesced_flush_queued = false;
+static std::atomic<bool> scene_collection_changing = false;
+
+static void DispatchSceneList()
+{
+	struct obs_frontend_source_list list = {};
+	obs_frontend_get_scenes(&list);
+	std::vector<const char *> scenes_vector;
+	for (size_t i = 0; i < list.sources.num; i++) {
+		obs_source_t *source = list.sources.array[i];
+		scenes_vector.push_back(obs_source_get_name(source));
+	}
+	nlohmann::json json = scenes_vector;
+	obs_frontend_source_list_free(&list);
+
+	DispatchJSEvent("obsSceneListChanged", json.dump());
+}
+
+static void DispatchTransitionList()
+{
+	struct obs_frontend_source_list list = {};
+	obs_frontend_get_transitions(&list);
+	std::vector<const char *> transitions_vector;
+	for (size_t i = 0; i < list.sources.num; i++) {
+		obs_source_t *source = list.sources.array[i];
+		transitions_vector.push_back(obs_source_get_name(source));
+	}
+	nlohmann::json json = transitions_vector;
+	obs_frontend_source_list_free(&list);
+
+	DispatchJSEvent("obsTransitionListChanged", json.dump());
+}
+
+static void QueueCoalescedEvent(uint32_t event)
+{
+	std::lock_guard<std::mutex> lock(coalesced_mutex);
+	if (!coalesced_events)
+		coalesced_since = os_gettime_ns();
+	coalesced_events |= event;
+}
+
+static uint32_t GetCoalescedStateTopics(uint32_t events)
+{
+	uint32_t topics = 0;
+	if (events & COALESCED_SCENE_LIST)
+		topics |= STATE_SCENES | STATE_CURRENT_SCENE;
+	if (events & COALESCED_TRANSITION_LIST)
+		topics |= STATE_TRANSITIONS | STATE_CURRENT_TRANSITION;
+	return topics;
+}
+
+/* UI thread only */
+static void FlushCoalescedEvents()
+{
+	uint32_t events;
+	{
+		std::lock_guard<std::mutex> lock(coalesced_mutex);
+		events = coalesced_events;
+		coalesced_events = 0;
+		coalesced_since = 0;
+	}
+
+	/* Before any page hears about the change and reads the lists */
+	InvalidateState(GetCoalescedStateTopics(events));
+
+	if (events & COALESCED_SCENE_LIST) {
+		DispatchSceneList();
+		UpdateState(STATE_SCENES | STATE_CURRENT_SCENE);
+	}
+	if (events & COALESCED_TRANSITION_LIST) {
+		DispatchTransitionList();
+		UpdateState(STATE_TRANSITIONS | STATE_CURRENT_TRANSITION);
+	}
+}
+
+static void coalesced_events_tick(void *, float)
+{
+	if (scene_collection_changing || coalesced_flush_queued)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(coalesced_mutex);
+		if (!coalesced_events ||
+		    os_gettime_ns() - coalesced_since <
+			    EVENT_COALESCE_WINDOW_NS)
+			return;
+	}
+
+	coalesced_flush_queued = true;
+	obs_queue_task(
+		OBS_TASK_UI,
+		[](void *) {
+			coalesced_flush_queued = false;
+			FlushCoalescedEvents();
+		},
+		nullptr, false);
+}
+
+static uint32_t GetEventStateTopics(enum obs_frontend_event event)
+{
+	switch (event) {
+	case OBS_FRONTEND_EVENT_STREAMING_STARTED:
+	case OBS_FRONTEND_EVENT_STREAMING_STOPPED:
+	case OBS_FRONTEND_EVENT_RECORDING_STARTED:
+	case OBS_FRONTEND_EVENT_RECORDING_PAUSED:
+	case OBS_FRONTEND_EVENT_RECORDING_UNPAUSED:
+	case OBS_FRONTEND_EVENT_RECORDING_STOPPED:
+	case OBS_FRONTEND_EVENT_REPLAY_BUFFER_STARTED:
+	case OBS_FRONTEND_EVENT_REPLAY_BUFFER_STOPPED:
+	case OBS_FRONTEND_EVENT_VIRTUALCAM_STARTED:
+	case OBS_FRONTEND_EVENT_VIRTUALCAM_STOPPED:
+		return STATE_STATUS;
+	case OBS_FRONTEND_EVENT_SCENE_CHANGED:
+		return STATE_CURRENT_SCENE;
+	case OBS_FRONTEND_EVENT_TRANSITION_CHANGED:
+		return STATE_CURRENT_TRANSITION;
+	case OBS_FRONTEND_EVENT_PROFILE_CHANGED:
+		/* The canvas size might have changed */
+		return STATE_CURRENT_SCENE;
+	case OBS_FRONTEND_EVENT_SCENE_COLLECTION_CHANGED:
+		return STATE_ALL & ~STATE_STATUS;
+	default:
+		return 0;
+	}
+}
+
 static void handle_obs_frontend_event(enum obs_frontend_event event, void *)
 {
+	/* The tracks in use can change in the settings at any time, they are
+	 * read again whenever an output starts */
+	switch (event) {
+	case OBS_FRONTEND_EVENT_FINISHED_LOADING:
+	case OBS_FRONTEND_EVENT_PROFILE_CHANGED:
+	case OBS_FRONTEND_EVENT_STREAMING_STARTING:
+	case OBS_FRONTEND_EVENT_RECORDING_STARTING:
+	case OBS_FRONTEND_EVENT_REPLAY_BUFFER_STARTING:
+		UpdateSharedDataMixes();
+		break;
+	default:;
+	}
+
+	/* Reads made while the events are held back see the new lists,
+	 * only the pushes wait for the coalescing window */
+	switch (event) {
+	case OBS_FRONTEND_EVENT_SCENE_LIST_CHANGED:
+		InvalidateState(GetCoalescedStateTopics(COALESCED_SCENE_LIST));
+		QueueCoalescedEvent(COALESCED_SCENE_LIST);
+		return;
+	case OBS_FRONTEND_EVENT_TRANSITION_LIST_CHANGED:
+		InvalidateState(
+			GetCoalescedStateTopics(COALESCED_TRANSITION_LIST));
+		QueueCoalescedEvent(COALESCED_TRANSITION_LIST);
+		return;
+	case OBS_FRONTEND_EVENT_SCENE_COLLECTION_CHANGING:
+		scene_collection_changing = true;
+		InvalidateState(STATE_ALL);
+		return;
+	case OBS_FRONTEND_EVENT_SCENE_COLLECTION_CHANGED:
+		scene_collection_changing = false;
+		break;
+	default:;
+	}
+
+	/* Every other event is delivered as-is, but must not overtake the
+	 * state changes that were queued before it.  While a collection is
+	 * loading, its lists are still incomplete and stay held back until
+	 * it has changed or coalesced_events_tick releases them. */
+	if (!scene_collection_changing)
+		FlushCoalescedEvents();
+
 	switch (event) {
 	case OBS_FRONTEND_EVENT_STREAMING_STARTING:
 		DispatchJSEvent("obsStreamingStarting", "null");
@@ -704,20 +956,6 @@ static void handle_obs_frontend_event(enum obs_frontend_event event, void *)
 		DispatchJSEvent("obsSceneChanged", json.dump());
 		break;
 	}
-	case OBS_FRONTEND_EVENT_SCENE_LIST_CHANGED: {
-		struct obs_frontend_source_list list = {};
-		obs_frontend_get_scenes(&list);
-		std::vector<const char *> scenes_vector;
-		for (size_t i = 0; i < list.sources.num; i++) {
-			obs_source_t *source = list.sources.array[i];
-			scenes_vector.push_back(obs_source_get_name(source));
-		}
-		nlohmann::json json = scenes_vector;
-		obs_frontend_source_list_free(&list);
-
-		DispatchJSEvent("obsSceneListChanged", json.dump());
-		break;
-	}
 	case OBS_FRONTEND_EVENT_TRANSITION_CHANGED: {
 		OBSSourceAutoRelease source =
 			obs_frontend_get_current_transition();
@@ -734,26 +972,13 @@ static void handle_obs_frontend_event(enum obs_frontend_event event, void *)
 		DispatchJSEvent("obsTransitionChanged", json.dump());
 		break;
 	}
-	case OBS_FRONTEND_EVENT_TRANSITION_LIST_CHANGED: {
-		struct obs_frontend_source_list list = {};
-		obs_frontend_get_transitions(&list);
-		std::vector<const char *> transitions_vector;
-		for (size_t i = 0; i < list.sources.num; i++) {
-			obs_source_t *source = list.sources.array[i];
-			transitions_vector.push_back(
-				obs_source_get_name(source));
-		}
-		nlohmann::json json = transitions_vector;
-		obs_frontend_source_list_free(&list);
-
-		DispatchJSEvent("obsTransitionListChanged", json.dump());
-		break;
-	}
 	case OBS_FRONTEND_EVENT_EXIT:
 		DispatchJSEvent("obsExit", "null");
 		break;
 	default:;
 	}
+
+	UpdateState(GetEventStateTopics(event));
 }
 #endif
 
@@ -828,6 +1053,15 @@ static void check_hwaccel_support(void)
 #endif
 #endif
 
+/* Upper bound for waiting on closing browsers when unloading, so a hanging
+ * renderer can't hold up quitting OBS indefinitely */
+#define CLOSE_TIMEOUT_MS 2000
+
+static void browser_creation_tick(void *, float)
+{
+	ScheduleBrowserCreation();
+}
+
 bool obs_module_load(void)
 {
 #ifdef ENABLE_BROWSER_QT_LOOP
@@ -855,13 +1089,21 @@ bool obs_module_load(void)
 	     cef_version_info(7), CEF_VERSION);
 
 	RegisterBrowserSource();
+	obs_add_tick_callback(browser_creation_tick, nullptr);
 
 #if BROWSER_FRONTEND_API_SUPPORT_ENABLED
 	obs_frontend_add_event_callback(handle_obs_frontend_event, nullptr);
+	obs_add_tick_callback(coalesced_events_tick, nullptr);
 #endif
 
-#ifdef ENABLE_BROWSER_SHARED_TEXTURE
 	OBSDataAutoRelease private_data = obs_get_private_data();
+	obs_data_set_default_int(private_data, "BrowserPoolSize", 2);
+	SetBrowserPoolSize(
+		(size_t)obs_data_get_int(private_data, "BrowserPoolSize"));
+	init_at_startup =
+		obs_data_get_bool(private_data, "BrowserInitAtStartup");
+
+#ifdef ENABLE_BROWSER_SHARED_TEXTURE
 	hwaccel = obs_data_get_bool(private_data, "BrowserHWAccel");
 
 	if (hwaccel) {
@@ -878,45 +1120,175 @@ bool obs_module_load(void)
 	return true;
 }
 
+/* Resolves the optional source_name/source_uuid of a vendor request.  An
+ * empty target means the request is broadcast to every browser source. */
+static bool GetVendorRequestTarget(obs_data_t *request_data,
+				   obs_data_t *response_data,
+				   OBSSourceAutoRelease &target)
+{
+	const char *name = obs_data_get_string(request_data, "source_name");
+	const char *uuid = obs_data_get_string(request_data, "source_uuid");
+
+	if (uuid && *uuid) {
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(29, 1, 0)
+		target = obs_get_source_by_uuid(uuid);
+#else
+		obs_data_set_string(response_data, "error",
+				    "source_uuid not supported");
+		return false;
+#endif
+	} else if (name && *name) {
+		target = obs_get_source_by_name(name);
+	} else {
+		return true;
+	}
+
+	if (!target ||
+	    strcmp(obs_source_get_id(target), "browser_source") != 0) {
+		obs_data_set_string(response_data, "error",
+				    "source is not a browser source");
+		return false;
+	}
+
+	return true;
+}
+
+/* The returned pointer stays valid for as long as the source is held */
+static inline BrowserSource *GetBrowserSource(obs_source_t *source)
+{
+	return source ? static_cast<BrowserSource *>(obs_obj_get_data(source))
+		      : nullptr;
+}
+
 void obs_module_post_load(void)
 {
+#ifndef ENABLE_BROWSER_QT_LOOP
+	/* CEF starts on the manager thread, so scene collection loading goes
+	 * on meanwhile, and browser sources wait in ScheduleBrowserCreation
+	 * instead of on CefInitialize */
+	if (init_at_startup)
+		obs_browser_initialize(nullptr);
+#endif
+
 	auto vendor = obs_websocket_register_vendor("obs-browser");
 	if (!vendor)
 		return;
 
-	auto emit_event_request_cb = [](obs_data_t *request_data, obs_data_t *,
-					void *) {
+	auto emit_event_request_cb = [](obs_data_t *request_data,
+					obs_data_t *response_data, void *) {
 		const char *event_name =
 			obs_data_get_string(request_data, "event_name");
 		if (!event_name)
 			return;
 
+		OBSSourceAutoRelease target;
+		if (!GetVendorRequestTarget(request_data, response_data,
+					    target))
+			return;
+
 		OBSDataAutoRelease event_data =
 			obs_data_get_obj(request_data, "event_data");
 		const char *event_data_string =
 			event_data ? obs_data_get_json(event_data) : "{}";
 
-		DispatchJSEvent(event_name, event_data_string, nullptr);
+		DispatchJSEvent(event_name, event_data_string,
+				GetBrowserSource(target));
+	};
+
+	auto emit_events_request_cb = [](obs_data_t *request_data,
+					 obs_data_t *response_data, void *) {
+		OBSDataArrayAutoRelease array =
+			obs_data_get_array(request_data, "events");
+		if (!array)
+			return;
+
+		OBSSourceAutoRelease target;
+		if (!GetVendorRequestTarget(request_data, response_data,
+					    target))
+			return;
+
+		std::vector<std::pair<std::string, std::string>> events;
+		size_t count = obs_data_array_count(array);
+		events.reserve(count);
+
+		for (size_t i = 0; i < count; i++) {
+			OBSDataAutoRelease item =
+				obs_data_array_item(array, i);
+			const char *event_name =
+				obs_data_get_string(item, "event_name");
+			if (!event_name || !*event_name)
+				continue;
+
+			OBSDataAutoRelease event_data =
+				obs_data_get_obj(item, "event_data");
+			events.emplace_back(
+				event_name,
+				event_data ? obs_data_get_json(event_data)
+					   : "{}");
+		}
+
+		DispatchJSEvents(events, GetBrowserSource(target));
 	};
 
 	if (!obs_websocket_vendor_register_request(
 		    vendor, "emit_event", emit_event_request_cb, nullptr))
 		blog(LOG_WARNING,
 		     "[obs-browser]: Failed to register obs-websocket request emit_event");
+	if (!obs_websocket_vendor_register_request(
+		    vendor, "emit_events", emit_events_request_cb, nullptr))
+		blog(LOG_WARNING,
+		     "[obs-browser]: Failed to register obs-websocket request emit_events");
 }
 
 void obs_module_unload(void)
 {
+	obs_remove_tick_callback(browser_creation_tick, nullptr);
+#if BROWSER_FRONTEND_API_SUPPORT_ENABLED
+	obs_remove_tick_callback(coalesced_events_tick, nullptr);
+#endif
+
 #ifdef USE_UI_LOOP
+	DeleteRetiredBrowsers();
+	ClearBrowserPool();
 	BrowserShutdown();
 #else
 	if (manager_thread.joinable()) {
-		while (!QueueCEFTask([]() { CefQuitMessageLoop(); }))
+		uint64_t start = os_gettime_ns();
+
+		/* Pooled browsers are counted as open as well, and so are
+		 * those of sources whose deletion couldn't be queued */
+		QueueCEFTask([]() {
+			DeleteRetiredBrowsers();
+			ClearBrowserPool();
+		});
+
+		/* Browsers that are still closing hold up CefShutdown.  The
+		 * manager thread uses the module's state until it exits, so
+		 * only this wait is bounded and the thread is always joined */
+		bool closed = WaitForBrowsersClosed(CLOSE_TIMEOUT_MS);
+		uint64_t closed_time = os_gettime_ns();
+
+		while (!QueueCEFTask([]() {
+			DeleteRetiredBrowsers();
+			ClearBrowserPool();
+			CefQuitMessageLoop();
+		}))
 			os_sleep_ms(5);
 
 		manager_thread.join();
+
+		blog(LOG_INFO,
+		     "[obs-browser]: Shutdown took %d ms, browsers %s "
+		     "after %d ms",
+		     (int)((os_gettime_ns() - start) / 1000000ULL),
+		     closed ? "closed" : "still open",
+		     (int)((closed_time - start) / 1000000ULL));
+	} else {
+		/* CEF never started, so these never had a browser */
+		DeleteRetiredBrowsers();
 	}
 #endif
 
+	StopSharedData();
 	os_event_destroy(cef_started_event);
 }
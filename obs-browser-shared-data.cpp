@@ -0,0 +1,243 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "browser-shared-data.hpp"
+
+#include <obs-module.h>
+#include <util/util_uint64.h>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#if BROWSER_FRONTEND_API_SUPPORT_ENABLED
+#include <obs-frontend-api.h>
+#include <util/config-file.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static_assert(SHARED_DATA_MIXES == MAX_AUDIO_MIXES,
+	      "shared data layout must cover every output mix");
+static_assert(SHARED_DATA_CHANNELS == MAX_AUDIO_CHANNELS,
+	      "shared data layout must cover every channel");
+
+static SharedMemory shared_memory;
+static SharedData *shared_data = nullptr;
+
+/* Written from the audio thread, taken by the tick on the graphics thread */
+static std::atomic<float> mix_peaks[SHARED_DATA_MIXES][SHARED_DATA_CHANNELS];
+
+/* The audio and tick callbacks are only registered while a browser has a
+ * page that reads the block, so that libobs doesn't output every mix for
+ * nothing.  Only the mixes the current outputs use are registered. */
+static std::mutex readers_mutex;
+static int readers = 0;
+static uint32_t registered_mixes = 0;
+static uint32_t enabled_mixes = 1;
+
+static void shared_data_audio(void *, size_t mix_idx, struct audio_data *data)
+{
+	size_t channels = audio_output_get_channels(obs_get_audio());
+
+	for (size_t ch = 0; ch < channels; ch++) {
+		const float *samples = (const float *)data->data[ch];
+		if (!samples)
+			continue;
+
+		float peak = 0.0f;
+		for (uint32_t i = 0; i < data->frames; i++) {
+			float sample = fabsf(samples[i]);
+			if (sample > peak)
+				peak = sample;
+		}
+
+		std::atomic<float> &out = mix_peaks[mix_idx][ch];
+		float cur = out.load(std::memory_order_relaxed);
+		while (peak > cur && !out.compare_exchange_weak(cur, peak))
+			;
+	}
+}
+
+uint64_t GetVideoFrameIndex(uint64_t frame_time)
+{
+	struct obs_video_info ovi;
+	if (!obs_get_video_info(&ovi) || !ovi.fps_den)
+		return 0;
+
+	return util_mul_div64(frame_time, ovi.fps_num,
+			      ovi.fps_den * 1000000000ULL);
+}
+
+static void shared_data_tick(void *, float)
+{
+	SharedDataHeader &header = shared_data->header;
+	uint32_t idx = (header.latest.load(std::memory_order_relaxed) + 1) %
+		       SHARED_DATA_RECORDS;
+	SharedDataRecord &record = shared_data->records[idx];
+
+	/* The sequence is odd while the record is being written, so readers
+	 * can tell a torn read apart.  The fence keeps the record's writes
+	 * from becoming visible before the odd sequence. */
+	uint32_t sequence = record.sequence.load(std::memory_order_relaxed);
+	record.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	record.video_time_ns = obs_get_video_frame_time();
+	record.frame = GetVideoFrameIndex(record.video_time_ns);
+
+	for (size_t mix = 0; mix < SHARED_DATA_MIXES; mix++) {
+		for (size_t ch = 0; ch < SHARED_DATA_CHANNELS; ch++) {
+			record.mix_peaks[mix][ch] = mix_peaks[mix][ch].exchange(
+				0.0f, std::memory_order_relaxed);
+		}
+	}
+
+	record.sequence.store(sequence + 2, std::memory_order_release);
+	header.latest.store(idx, std::memory_order_release);
+}
+
+static std::string GetSharedDataName()
+{
+#ifdef _WIN32
+	return "obs-browser-shared-data-" +
+	       std::to_string(GetCurrentProcessId());
+#else
+	return "/obs-browser-" + std::to_string(getpid());
+#endif
+}
+
+std::string StartSharedData()
+{
+	std::string name = GetSharedDataName();
+
+	if (!shared_memory.Create(name, sizeof(SharedData))) {
+		blog(LOG_WARNING,
+		     "[obs-browser]: Failed to create shared data block '%s'",
+		     name.c_str());
+		return std::string();
+	}
+
+	shared_data = (SharedData *)shared_memory.Get();
+
+	SharedDataHeader &header = shared_data->header;
+	header.version = SHARED_DATA_VERSION;
+	header.header_size = sizeof(SharedDataHeader);
+	header.record_size = sizeof(SharedDataRecord);
+	header.record_count = SHARED_DATA_RECORDS;
+	header.latest = SHARED_DATA_RECORDS - 1;
+	header.mix_count = SHARED_DATA_MIXES;
+	header.channel_count = SHARED_DATA_CHANNELS;
+	std::atomic_thread_fence(std::memory_order_release);
+	header.magic = SHARED_DATA_MAGIC;
+
+	return name;
+}
+
+/* Called with readers_mutex held */
+static void RegisterMixes(uint32_t mixes)
+{
+	for (size_t mix = 0; mix < SHARED_DATA_MIXES; mix++) {
+		uint32_t bit = 1 << mix;
+		if ((mixes & bit) && !(registered_mixes & bit))
+			obs_add_raw_audio_callback(mix, nullptr,
+						   shared_data_audio, nullptr);
+		else if (!(mixes & bit) && (registered_mixes & bit))
+			obs_remove_raw_audio_callback(mix, shared_data_audio,
+						      nullptr);
+	}
+
+	registered_mixes = mixes;
+}
+
+void AddSharedDataReader()
+{
+	std::lock_guard<std::mutex> lock(readers_mutex);
+	if (!shared_data || readers++)
+		return;
+
+	RegisterMixes(enabled_mixes);
+	obs_add_tick_callback(shared_data_tick, nullptr);
+}
+
+void RemoveSharedDataReader()
+{
+	std::lock_guard<std::mutex> lock(readers_mutex);
+	if (!shared_data || !readers || --readers)
+		return;
+
+	obs_remove_tick_callback(shared_data_tick, nullptr);
+	RegisterMixes(0);
+}
+
+/* The mixes that the stream and recordings of the current profile use.
+ * Peaks of the other mixes stay at 0. */
+static uint32_t GetEnabledMixes()
+{
+	uint32_t all = (1 << SHARED_DATA_MIXES) - 1;
+
+#if BROWSER_FRONTEND_API_SUPPORT_ENABLED
+	config_t *config = obs_frontend_get_profile_config();
+	if (!config)
+		return all;
+
+	const char *mode = config_get_string(config, "Output", "Mode");
+	if (!mode || strcmp(mode, "Advanced") != 0)
+		return 1;
+
+	uint32_t mixes =
+		(uint32_t)config_get_int(config, "AdvOut", "RecTracks");
+	int64_t track = config_get_int(config, "AdvOut", "TrackIndex");
+	if (track >= 1 && track <= SHARED_DATA_MIXES)
+		mixes |= 1 << (track - 1);
+
+	return (mixes & all) ? mixes & all : 1;
+#else
+	return all;
+#endif
+}
+
+void UpdateSharedDataMixes()
+{
+	uint32_t mixes = GetEnabledMixes();
+
+	std::lock_guard<std::mutex> lock(readers_mutex);
+	enabled_mixes = mixes;
+	if (shared_data && readers)
+		RegisterMixes(mixes);
+}
+
+void StopSharedData()
+{
+	std::lock_guard<std::mutex> lock(readers_mutex);
+	if (!shared_data)
+		return;
+
+	if (readers) {
+		obs_remove_tick_callback(shared_data_tick, nullptr);
+		RegisterMixes(0);
+		readers = 0;
+	}
+
+	shared_data = nullptr;
+	shared_memory.Close();
+}
@@ -17,55 +17,102 @@
 
 #include "obs-browser-source.hpp"
 #if CHROME_VERSION_BUILD < 4103
-void BrowserSource::EnumAudioStreams(obs_source_enum_proc_t cb, void *param)
+#include "browser-audio-mix.hpp"
+#include <algorithm>
+
+void BrowserSource::PublishAudioSources(
+	std::shared_ptr<const AudioSourceList> list,
+	std::vector<OBSSourceAutoRelease> removed)
 {
-	std::lock_guard<std::mutex> lock(audio_sources_mutex);
-	for (obs_source_t *audio_source : audio_sources) {
-		cb(source, audio_source, param);
+	std::shared_ptr<const AudioSourceList> old =
+		std::atomic_exchange(&audio_sources, std::move(list));
+
+	{
+		std::lock_guard<std::mutex> lock(retired_audio_sources_mutex);
+		retired_audio_sources.push_back(
+			{std::move(old), std::move(removed)});
 	}
+
+	PruneRetiredAudioSources();
 }
 
-static inline void mix_audio(float *__restrict p_out,
-			     const float *__restrict p_in, size_t pos,
-			     size_t count)
+std::shared_ptr<const AudioSourceList> BrowserSource::GetAudioSources()
 {
-	float *__restrict out = p_out;
-	const float *__restrict in = p_in + pos;
-	const float *__restrict end = in + count;
+	return std::atomic_load(&audio_sources);
+}
 
-	while (in < end)
-		*out++ += *in++;
+/* Also called from Tick, so that the sources of the last list a browser
+ * published are released once the audio thread is done with them */
+void BrowserSource::PruneRetiredAudioSources()
+{
+	std::vector<RetiredAudioSources> unused;
+
+	{
+		std::lock_guard<std::mutex> lock(retired_audio_sources_mutex);
+		if (retired_audio_sources.empty())
+			return;
+
+		/* Anything only referenced from here is no longer being
+		 * mixed */
+		auto used = [](const RetiredAudioSources &retired) {
+			return retired.list.use_count() > 1;
+		};
+		auto it = std::partition(retired_audio_sources.begin(),
+					 retired_audio_sources.end(), used);
+		unused.assign(std::make_move_iterator(it),
+			      std::make_move_iterator(
+				      retired_audio_sources.end()));
+		retired_audio_sources.erase(it, retired_audio_sources.end());
+	}
+
+	/* Released without holding the lock */
+	unused.clear();
+}
+
+void BrowserSource::EnumAudioStreams(obs_source_enum_proc_t cb, void *param)
+{
+	std::shared_ptr<const AudioSourceList> sources = GetAudioSources();
+	if (!sources)
+		return;
+
+	for (obs_source_t *audio_source : *sources) {
+		cb(source, audio_source, param);
+	}
 }
 
 bool BrowserSource::AudioMix(uint64_t *ts_out,
 			     struct audio_output_data *audio_output,
 			     size_t channels, size_t sample_rate)
 {
+	std::shared_ptr<const AudioSourceList> sources = GetAudioSources();
+	if (!sources)
+		return false;
+
+	/* Only the audio thread mixes, so the scratch space can be reused */
+	thread_local std::vector<uint64_t> timestamps;
+	timestamps.resize(sources->size());
+
 	uint64_t timestamp = 0;
 	struct obs_source_audio_mix child_audio;
 
-	std::lock_guard<std::mutex> lock(audio_sources_mutex);
-	for (obs_source_t *s : audio_sources) {
-		if (!obs_source_audio_pending(s)) {
-			uint64_t source_ts = obs_source_get_audio_timestamp(s);
+	for (size_t i = 0; i < sources->size(); i++) {
+		obs_source_t *s = (*sources)[i];
+		uint64_t source_ts = 0;
+		if (!obs_source_audio_pending(s))
+			source_ts = obs_source_get_audio_timestamp(s);
 
-			if (source_ts && (!timestamp || source_ts < timestamp))
-				timestamp = source_ts;
-		}
+		timestamps[i] = source_ts;
+		if (source_ts && (!timestamp || source_ts < timestamp))
+			timestamp = source_ts;
 	}
 
 	if (!timestamp)
 		return false;
 
-	for (obs_source_t *s : audio_sources) {
-		uint64_t source_ts;
+	for (size_t i = 0; i < sources->size(); i++) {
+		uint64_t source_ts = timestamps[i];
 		size_t pos, count;
 
-		if (obs_source_audio_pending(s)) {
-			continue;
-		}
-
-		source_ts = obs_source_get_audio_timestamp(s);
 		if (!source_ts) {
 			continue;
 		}
@@ -74,7 +121,7 @@ bool BrowserSource::AudioMix(uint64_t *ts_out,
 						 source_ts - timestamp);
 		count = AUDIO_OUTPUT_FRAMES - pos;
 
-		obs_source_get_audio_mix(s, &child_audio);
+		obs_source_get_audio_mix((*sources)[i], &child_audio);
 		for (size_t ch = 0; ch < channels; ch++) {
 			float *out = audio_output->data[ch];
 			float *in = child_audio.output[0].data[ch];
@@ -86,4 +133,115 @@ bool BrowserSource::AudioMix(uint64_t *ts_out,
 	*ts_out = timestamp;
 	return true;
 }
+#elif ENABLE_PAGE_AUDIO_STREAMS
+#include <util/platform.h>
+#include <util/util_uint64.h>
+
+static speaker_layout GetPageSpeakerLayout(size_t channels)
+{
+	switch (channels) {
+	case 1:
+		return SPEAKERS_MONO;
+	case 2:
+		return SPEAKERS_STEREO;
+	case 3:
+		return SPEAKERS_2POINT1;
+	case 4:
+		return SPEAKERS_4POINT0;
+	case 5:
+		return SPEAKERS_4POINT1;
+	case 6:
+		return SPEAKERS_5POINT1;
+	case 8:
+		return SPEAKERS_7POINT1;
+	default:
+		return SPEAKERS_UNKNOWN;
+	}
+}
+
+/* Called on the CEF thread for every chunk a page sends, delay is the time
+ * since the page sent it */
+void BrowserSource::OutputPageAudio(const std::string &name,
+				    uint32_t sample_rate, const float **data,
+				    size_t channels, size_t frames,
+				    uint64_t delay)
+{
+	speaker_layout speakers = GetPageSpeakerLayout(channels);
+	if (speakers == SPEAKERS_UNKNOWN || !sample_rate)
+		return;
+
+	std::lock_guard<std::mutex> lock(page_audio_mutex);
+	auto it = page_audio_streams.find(name);
+
+	if (it == page_audio_streams.end()) {
+		/* Every stream is a source of its own */
+		if (page_audio_streams.size() >= MAX_PAGE_AUDIO_STREAMS) {
+			if (!page_audio_limit_warned)
+				blog(LOG_WARNING,
+				     "[obs-browser]: '%s' tried to output "
+				     "more than %d audio streams",
+				     obs_source_get_name(source),
+				     MAX_PAGE_AUDIO_STREAMS);
+			page_audio_limit_warned = true;
+			return;
+		}
+		it = page_audio_streams.emplace(name, nullptr).first;
+	}
+
+	std::unique_ptr<PageAudioStream> &stream = it->second;
+	if (!stream) {
+		std::string source_name = obs_source_get_name(source);
+		source_name += ": " + name;
+
+		stream = std::make_unique<PageAudioStream>();
+		stream->source = obs_source_create_private(
+			"audio_line", source_name.c_str(), nullptr);
+		obs_source_add_active_child(source, stream->source);
+	}
+
+	if (stream->channels != channels ||
+	    stream->sample_rate != sample_rate) {
+		stream->channels = channels;
+		stream->sample_rate = sample_rate;
+		stream->buffer.Start(stream->source, speakers, sample_rate);
+	}
+
+	/* Pages send audio as soon as it is rendered, so it ended when the
+	 * page sent it.  How long delivery takes varies with load, which the
+	 * buffer measures as jitter and smooths out. */
+	uint64_t duration = util_mul_div64(frames, 1000000000ULL, sample_rate);
+	stream->buffer.Push(stream->source, data, frames,
+			    os_gettime_ns() - delay - duration);
+}
+
+/* Pages stop sending when a sound ends, the video tick outputs what the
+ * buffers still hold back */
+void BrowserSource::FlushIdlePageAudio()
+{
+	std::lock_guard<std::mutex> lock(page_audio_mutex);
+	for (auto &pair : page_audio_streams)
+		pair.second->buffer.FlushIdle(pair.second->source);
+}
+
+void BrowserSource::FadePageAudio(bool suspended)
+{
+	std::lock_guard<std::mutex> lock(page_audio_mutex);
+	for (auto &pair : page_audio_streams) {
+		if (suspended)
+			pair.second->buffer.FadeOut(pair.second->source);
+		else
+			pair.second->buffer.FadeIn();
+	}
+}
+
+void BrowserSource::ClearPageAudioStreams()
+{
+	std::lock_guard<std::mutex> lock(page_audio_mutex);
+	for (auto &pair : page_audio_streams) {
+		if (source)
+			obs_source_remove_active_child(source,
+						       pair.second->source);
+	}
+	page_audio_streams.clear();
+}
 #endif
@@ -17,15 +17,20 @@
  ******************************************************************************/
 
 #include "obs-browser-source.hpp"
+#include "browser-state.hpp"
 #include "browser-client.hpp"
 #include "browser-scheme.hpp"
+#include "browser-shared-data.hpp"
 #include "wide-string.hpp"
 #include <nlohmann/json.hpp>
 #include <util/threading.h>
 #include <util/dstr.h>
+#include <util/util_uint64.h>
+#include <algorithm>
 #include <functional>
 #include <thread>
 #include <mutex>
+#include <vector>
 
 #ifdef __linux__
 #include "linux-keyboard-helpers.hpp"
@@ -41,10 +46,23 @@
 using namespace std;
 
 extern bool QueueCEFTask(std::function<void()> task);
+extern os_event_t *cef_started_event;
+extern void AddMediaFlag(bool enabled);
 
 static mutex browser_list_mutex;
 static BrowserSource *first_browser = nullptr;
 
+/* Sources destroyed in a burst, e.g. when switching scene collections, are
+ * deleted together in one CEF task, so that every browser has been asked
+ * to close before any other task runs, and CEF closes them in parallel */
+static mutex retired_browsers_mutex;
+static std::vector<BrowserSource *> retired_browsers;
+static bool retired_browsers_queued = false;
+
+/* Source browsers that have been created and not yet closed */
+static std::atomic<int> open_browsers = 0;
+static std::atomic<uint64_t> teardown_started = 0;
+
 static void SendBrowserVisibility(CefRefPtr<CefBrowser> browser, bool isVisible)
 {
 	if (!browser)
@@ -67,6 +85,17 @@ static void SendBrowserVisibility(CefRefPtr<CefBrowser> browser, bool isVisible)
 	SendBrowserProcessMessage(browser, PID_RENDERER, msg);
 }
 
+/* The renderer keeps the CSS in a constructed CSSStyleSheet that the page
+ * adopts through document.adoptedStyleSheets, and replaces its rules, see
+ * BrowserApp::ApplyCSS */
+void SendBrowserCSS(CefRefPtr<CefBrowser> browser, const std::string &css)
+{
+	CefRefPtr<CefProcessMessage> msg = CefProcessMessage::Create("SetCSS");
+	CefRefPtr<CefListValue> args = msg->GetArgumentList();
+	args->SetString(0, css);
+	SendBrowserProcessMessage(browser, PID_RENDERER, msg);
+}
+
 void DispatchJSEvent(std::string eventName, std::string jsonString,
 		     BrowserSource *browser = nullptr);
 
@@ -103,6 +132,68 @@ BrowserSource::BrowserSource(obs_data_t *, obs_source_t *source_)
 		"void javascript_event(string eventName, string jsonString)",
 		jsEventFunction, (void *)this);
 
+#if CHROME_VERSION_BUILD >= 4103
+	auto audioStatsFunction = [](void *p, calldata_t *calldata) {
+		BrowserSource *bs = (BrowserSource *)p;
+		AudioBufferStats stats = bs->audio_buffer.GetStats();
+		calldata_set_int(calldata, "buffered_frames",
+				 stats.buffered_frames);
+		calldata_set_int(calldata, "depth_ms", stats.depth_ms);
+		calldata_set_float(calldata, "jitter_ms", stats.jitter_ms);
+		calldata_set_int(calldata, "underruns",
+				 (long long)stats.underruns);
+		calldata_set_int(calldata, "corrections",
+				 (long long)stats.corrections);
+		calldata_set_float(calldata, "buffer_latency_ms",
+				   stats.buffer_latency_ms);
+		calldata_set_float(calldata, "max_buffer_latency_ms",
+				   stats.max_buffer_latency_ms);
+	};
+
+	proc_handler_add(ph,
+			 "void get_audio_stats(out int buffered_frames, "
+			 "out int depth_ms, out float jitter_ms, "
+			 "out int underruns, out int corrections, "
+			 "out float buffer_latency_ms, "
+			 "out float max_buffer_latency_ms)",
+			 audioStatsFunction, (void *)this);
+#endif
+
+#if ENABLE_PAGE_AUDIO_STREAMS
+	auto audioStreamsFunction = [](void *p, calldata_t *calldata) {
+		BrowserSource *bs = (BrowserSource *)p;
+		nlohmann::json streams = nlohmann::json::array();
+
+		std::lock_guard<std::mutex> lock(bs->page_audio_mutex);
+		for (auto &pair : bs->page_audio_streams)
+			streams.push_back(pair.first);
+		calldata_set_string(calldata, "streams",
+				    streams.dump().c_str());
+	};
+
+	/* Returns a new reference, which the caller has to release with
+	 * obs_source_release */
+	auto audioStreamSourceFunction = [](void *p, calldata_t *calldata) {
+		BrowserSource *bs = (BrowserSource *)p;
+		const char *name = calldata_string(calldata, "stream");
+		obs_source_t *stream_source = nullptr;
+
+		std::lock_guard<std::mutex> lock(bs->page_audio_mutex);
+		auto stream = bs->page_audio_streams.find(name ? name : "");
+		if (stream != bs->page_audio_streams.end() && stream->second)
+			stream_source =
+				obs_source_get_ref(stream->second->source);
+		calldata_set_ptr(calldata, "source", stream_source);
+	};
+
+	proc_handler_add(ph, "void get_audio_streams(out string streams)",
+			 audioStreamsFunction, (void *)this);
+	proc_handler_add(ph,
+			 "void get_audio_stream_source(in string stream, "
+			 "out ptr source)",
+			 audioStreamSourceFunction, (void *)this);
+#endif
+
 	/* defer update */
 	obs_source_update(source, nullptr);
 
@@ -133,6 +224,10 @@ static void ActuallyCloseBrowser(CefRefPtr<CefBrowser> cefBrowser)
 
 BrowserSource::~BrowserSource()
 {
+	if (pending_client)
+		pending_client->bs = nullptr;
+	for (CefRefPtr<BrowserClient> &client : dropped_clients)
+		client->bs = nullptr;
 	if (cefBrowser)
 		ActuallyCloseBrowser(cefBrowser);
 }
@@ -142,16 +237,84 @@ void BrowserSource::Destroy()
 	destroying = true;
 	DestroyTextures();
 
-	lock_guard<mutex> lock(browser_list_mutex);
-	if (next)
-		next->p_prev_next = p_prev_next;
-	*p_prev_next = next;
+	{
+		lock_guard<mutex> lock(browser_list_mutex);
+		if (next)
+			next->p_prev_next = p_prev_next;
+		*p_prev_next = next;
+	}
 
-	QueueCEFTask([this]() { delete this; });
+	/* If the task can't be posted, the next source that is destroyed
+	 * tries again, and unloading deletes whatever is left */
+	bool queue;
+	{
+		lock_guard<mutex> lock(retired_browsers_mutex);
+		retired_browsers.push_back(this);
+		queue = !retired_browsers_queued;
+		retired_browsers_queued = true;
+	}
+	if (queue && !QueueCEFTask(DeleteRetiredBrowsers)) {
+		lock_guard<mutex> lock(retired_browsers_mutex);
+		retired_browsers_queued = false;
+	}
 
 	source = nullptr;
 }
 
+void DeleteRetiredBrowsers()
+{
+	std::vector<BrowserSource *> sources;
+	{
+		lock_guard<mutex> lock(retired_browsers_mutex);
+		sources.swap(retired_browsers);
+		retired_browsers_queued = false;
+	}
+
+	uint64_t start = os_gettime_ns();
+	for (BrowserSource *bs : sources)
+		delete bs;
+
+	if (sources.size() > 1) {
+		uint64_t expected = 0;
+		teardown_started.compare_exchange_strong(expected, start);
+
+		blog(LOG_INFO,
+		     "[obs-browser]: Destroyed %d sources in %d ms, "
+		     "%d browsers still closing",
+		     (int)sources.size(),
+		     (int)((os_gettime_ns() - start) / 1000000ULL),
+		     (int)open_browsers);
+	}
+}
+
+void BrowserOpened()
+{
+	open_browsers++;
+}
+
+void BrowserClosed()
+{
+	if (--open_browsers > 0)
+		return;
+
+	uint64_t start = teardown_started.exchange(0);
+	if (start)
+		blog(LOG_INFO, "[obs-browser]: All browsers closed %d ms "
+			       "after teardown started",
+		     (int)((os_gettime_ns() - start) / 1000000ULL));
+}
+
+bool WaitForBrowsersClosed(uint32_t timeout_ms)
+{
+	uint64_t deadline = os_gettime_ns() + timeout_ms * 1000000ULL;
+	while (open_browsers > 0) {
+		if (os_gettime_ns() >= deadline)
+			return false;
+		os_sleep_ms(5);
+	}
+	return true;
+}
+
 void BrowserSource::ExecuteOnBrowser(BrowserFunc func, bool async)
 {
 	if (!async) {
@@ -174,7 +337,15 @@ void BrowserSource::ExecuteOnBrowser(BrowserFunc func, bool async)
 		}
 		os_event_destroy(finishedEvent);
 	} else {
-		CefRefPtr<CefBrowser> browser = GetBrowser();
+		std::unique_lock<std::recursive_mutex> lock(lockBrowser);
+		CefRefPtr<CefBrowser> browser = cefBrowser;
+		if (!browser && pending_client) {
+			/* Run once the browser exists, see OnBrowserCreated */
+			pending_tasks.push_back(func);
+			return;
+		}
+		lock.unlock();
+
 		if (!!browser) {
 #ifdef ENABLE_BROWSER_QT_LOOP
 			QueueBrowserTask(cefBrowser, func);
@@ -185,6 +356,161 @@ void BrowserSource::ExecuteOnBrowser(BrowserFunc func, bool async)
 	}
 }
 
+/* ========================================================================= */
+/* Browsers kept ready on about:blank, so that adding or showing a source
+ * only has to navigate one instead of waiting for a renderer process to
+ * spawn and initialize.  Windowless browsers ask their client for the view
+ * size, so a pooled browser fits a source of any size.  The pool itself is
+ * only touched on the CEF UI thread. */
+
+#define MAX_POOLED_BROWSERS 8
+
+struct PooledBrowser {
+	CefRefPtr<CefBrowser> browser;
+	CefRefPtr<BrowserClient> client;
+};
+
+static std::vector<PooledBrowser> browser_pool;
+static std::atomic<size_t> browser_pool_size = 0;
+static std::atomic<size_t> browser_pool_count = 0;
+static std::atomic<bool> browser_pool_filling = false;
+
+static void FillBrowserPool()
+{
+	if (browser_pool.size() >= browser_pool_size) {
+		browser_pool_filling = false;
+		return;
+	}
+
+	/* Decided the same way as for a source's own browser, see
+	 * BrowserSource::CreateBrowser */
+	bool sharing_avail = false;
+#ifdef ENABLE_BROWSER_SHARED_TEXTURE
+	if (hwaccel) {
+		obs_enter_graphics();
+		sharing_avail = gs_shared_texture_available();
+		obs_leave_graphics();
+	}
+#endif
+
+	CefRefPtr<BrowserClient> client = new BrowserClient(
+		nullptr, hwaccel && sharing_avail, true, DEFAULT_CONTROL_LEVEL);
+	client->pooled = true;
+
+	CefWindowInfo windowInfo;
+#if CHROME_VERSION_BUILD < 4430
+	windowInfo.width = 16;
+	windowInfo.height = 16;
+#else
+	windowInfo.bounds.width = 16;
+	windowInfo.bounds.height = 16;
+#endif
+	windowInfo.windowless_rendering_enabled = true;
+
+#ifdef ENABLE_BROWSER_SHARED_TEXTURE
+	windowInfo.shared_texture_enabled = hwaccel;
+#ifdef BROWSER_EXTERNAL_BEGIN_FRAME_ENABLED
+	windowInfo.external_begin_frame_enabled = true;
+#endif
+#endif
+
+	CefBrowserSettings cefBrowserSettings;
+	cefBrowserSettings.default_font_size = 16;
+	cefBrowserSettings.default_fixed_font_size = 16;
+
+	/* Added to the pool by AddPooledBrowser.  Pooled browsers are only
+	 * adopted by sources without the media stream flag */
+	AddMediaFlag(false);
+
+	/* Counted as open from now on, so that unloading waits for pooled
+	 * browsers that are still being created */
+	BrowserOpened();
+	if (!CefBrowserHost::CreateBrowser(windowInfo, client, "about:blank",
+					   cefBrowserSettings,
+					   CefRefPtr<CefDictionaryValue>(),
+					   nullptr)) {
+		blog(LOG_WARNING, "[obs-browser]: Failed to create "
+				  "pooled browser, disabling pool");
+		BrowserClosed();
+		browser_pool_size = 0;
+		browser_pool_filling = false;
+	}
+}
+
+void AddPooledBrowser(CefRefPtr<CefBrowser> browser,
+		      CefRefPtr<BrowserClient> client)
+{
+	if (browser_pool.size() < browser_pool_size) {
+		browser->GetHost()->WasHidden(true);
+		browser_pool.push_back({browser, client});
+	} else {
+		/* The pool was cleared while it was being created */
+		browser->GetHost()->CloseBrowser(true);
+	}
+
+	browser_pool_count = browser_pool.size();
+	browser_pool_filling = false;
+}
+
+static PooledBrowser AdoptPooledBrowser(BrowserSource *bs, bool sharing_avail,
+					int frame_rate)
+{
+	/* A browser paints either into a shared texture or into memory for
+	 * its whole life, so one created the other way can't be adopted */
+	if (browser_pool.empty() ||
+	    browser_pool.back().client->SharingAvailable() != sharing_avail)
+		return {};
+
+	PooledBrowser pooled = std::move(browser_pool.back());
+	browser_pool.pop_back();
+	browser_pool_count = browser_pool.size();
+
+	{
+		std::lock_guard<std::recursive_mutex> lock(bs->lockBrowser);
+		bs->pending_client = pooled.client;
+	}
+
+	pooled.client->Adopt(bs, sharing_avail, bs->reroute_audio,
+			     bs->webpage_control_level);
+
+	CefRefPtr<CefBrowserHost> host = pooled.browser->GetHost();
+	if (frame_rate)
+		host->SetWindowlessFrameRate(frame_rate);
+	host->WasResized();
+	SendBrowserCSS(pooled.browser, bs->css);
+	pooled.browser->GetMainFrame()->LoadURL(bs->url);
+	return pooled;
+}
+
+void SetBrowserPoolSize(size_t size)
+{
+	browser_pool_size = std::min(size, (size_t)MAX_POOLED_BROWSERS);
+}
+
+void RefillBrowserPool()
+{
+	if (browser_pool_count >= browser_pool_size)
+		return;
+	if (os_event_try(cef_started_event) != 0)
+		return;
+	if (browser_pool_filling.exchange(true))
+		return;
+
+	if (!QueueCEFTask(FillBrowserPool))
+		browser_pool_filling = false;
+}
+
+void ClearBrowserPool()
+{
+	browser_pool_size = 0;
+	for (PooledBrowser &pooled : browser_pool)
+		pooled.browser->GetHost()->CloseBrowser(true);
+	browser_pool.clear();
+	browser_pool_count = 0;
+}
+
+/* ========================================================================= */
+
 bool BrowserSource::CreateBrowser()
 {
 	return QueueCEFTask([this]() {
@@ -198,10 +524,6 @@ bool BrowserSource::CreateBrowser()
 		bool hwaccel = false;
 #endif
 
-		CefRefPtr<BrowserClient> browserClient =
-			new BrowserClient(this, hwaccel && tex_sharing_avail,
-					  reroute_audio, webpage_control_level);
-
 		CefWindowInfo windowInfo;
 #if CHROME_VERSION_BUILD < 4430
 		windowInfo.width = width;
@@ -217,6 +539,7 @@ bool BrowserSource::CreateBrowser()
 #endif
 
 		CefBrowserSettings cefBrowserSettings;
+		bool use_pool = !is_media_flag;
 
 #ifdef ENABLE_BROWSER_SHARED_TEXTURE
 #ifdef BROWSER_EXTERNAL_BEGIN_FRAME_ENABLED
@@ -225,6 +548,7 @@ bool BrowserSource::CreateBrowser()
 			cefBrowserSettings.windowless_frame_rate = 0;
 		} else {
 			cefBrowserSettings.windowless_frame_rate = fps;
+			use_pool = false;
 		}
 #else
 		struct obs_video_info ovi;
@@ -245,31 +569,114 @@ bool BrowserSource::CreateBrowser()
 			/* Disable web security for file:// URLs to allow
 			 * local content access to remote APIs */
 			cefBrowserSettings.web_security = STATE_DISABLED;
+			use_pool = false;
 		}
 #endif
-		auto browser = CefBrowserHost::CreateBrowserSync(
-			windowInfo, browserClient, url, cefBrowserSettings,
-			CefRefPtr<CefDictionaryValue>(), nullptr);
+		if (use_pool) {
+			PooledBrowser pooled = AdoptPooledBrowser(
+				this, hwaccel && tex_sharing_avail,
+				cefBrowserSettings.windowless_frame_rate);
+			if (pooled.browser) {
+				OnBrowserCreated(pooled.client, pooled.browser);
+				return;
+			}
+		}
 
-		if (browser) {
-			blog(LOG_INFO, "CreateBrowserSync - success");
-		} else {
-			blog(LOG_INFO, "CreateBrowserSync - fail");
+		CefRefPtr<BrowserClient> browserClient =
+			new BrowserClient(this, hwaccel && tex_sharing_avail,
+					  reroute_audio, webpage_control_level);
+
+		/* Lets the renderer apply the CSS to the first document, see
+		 * BrowserApp::ApplyCSS */
+		CefRefPtr<CefDictionaryValue> extraInfo =
+			CefDictionaryValue::Create();
+		extraInfo->SetString("css", css);
+
+		/* Calls made until BrowserClient::OnAfterCreated hands over
+		 * the browser are queued by ExecuteOnBrowser */
+		{
+			std::lock_guard<std::recursive_mutex> lock(lockBrowser);
+			pending_client = browserClient;
 		}
 
+		AddMediaFlag(is_media_flag);
+		if (!CefBrowserHost::CreateBrowser(windowInfo, browserClient,
+						   url, cefBrowserSettings,
+						   extraInfo, nullptr)) {
+			blog(LOG_INFO, "CreateBrowser - fail");
+
+			std::lock_guard<std::recursive_mutex> lock(lockBrowser);
+			pending_client = nullptr;
+			pending_tasks.clear();
+			FinishLoading(false);
+		}
+	});
+}
+
+void BrowserSource::OnBrowserCreated(CefRefPtr<BrowserClient> client,
+				     CefRefPtr<CefBrowser> browser)
+{
+	std::vector<BrowserFunc> tasks;
+	{
+		std::lock_guard<std::recursive_mutex> lock(lockBrowser);
+		if (pending_client != client) {
+			/* DestroyBrowser let go of it while it was being
+			 * created, or another browser has been requested
+			 * since */
+			client->bs = nullptr;
+			browser->GetHost()->CloseBrowser(true);
+			return;
+		}
+		pending_client = nullptr;
+		tasks.swap(pending_tasks);
 		SetBrowser(browser);
+	}
 
-		if (reroute_audio)
-			cefBrowser->GetHost()->SetAudioMuted(true);
-		if (obs_source_showing(source))
-			is_showing = true;
+	create_finished = os_gettime_ns();
 
-		SendBrowserVisibility(cefBrowser, is_showing);
-	});
+	if (reroute_audio)
+		browser->GetHost()->SetAudioMuted(true);
+	if (obs_source_showing(source))
+		is_showing = true;
+
+	SendBrowserVisibility(browser, is_showing);
+
+	/* A new page starts out active, even if the source was hidden while
+	 * its browser was being created */
+	page_frozen = false;
+	SetFrozen(!is_showing && freeze_on_invisible);
+
+	for (BrowserFunc &task : tasks)
+		task(browser);
 }
 
 void BrowserSource::DestroyBrowser()
 {
+	loading = false;
+	page_frozen = false;
+	video_tick = false;
+
+	/* A browser that is still being created is closed as soon as it
+	 * exists, see OnBrowserCreated.  BrowserClient::bs is only written
+	 * on the CEF UI thread, where OnAfterCreated reads it.  The source
+	 * may be deleted there before a queued task gets to it, so the
+	 * destructor clears it too */
+	{
+		std::lock_guard<std::recursive_mutex> lock(lockBrowser);
+		if (pending_client) {
+			CefRefPtr<BrowserClient> client = pending_client;
+			if (CefCurrentlyOn(TID_UI)) {
+				client->bs = nullptr;
+			} else {
+				QueueCEFTask(
+					[client]() { client->bs = nullptr; });
+				dropped_clients.push_back(client);
+			}
+			pending_client = nullptr;
+			pending_tasks.clear();
+		}
+	}
+
 	ExecuteOnBrowser(ActuallyCloseBrowser, true);
 	SetBrowser(nullptr);
 }
@@ -277,9 +684,12 @@ void BrowserSource::DestroyBrowser()
 void BrowserSource::ClearAudioStreams()
 {
 	QueueCEFTask([this]() {
+		std::vector<OBSSourceAutoRelease> removed;
+		for (auto &pair : audio_streams)
+			removed.push_back(std::move(pair.second.source));
 		audio_streams.clear();
-		std::lock_guard<std::mutex> lock(audio_sources_mutex);
-		audio_sources.clear();
+
+		PublishAudioSources(nullptr, std::move(removed));
 	});
 }
 #endif
@@ -416,6 +826,9 @@ void BrowserSource::SetShowing(bool showing)
 		return;
 
 	is_showing = showing;
+#if CHROME_VERSION_BUILD >= 4103
+	UpdateAudioSuspended();
+#endif
 
 	if (shutdown_on_invisible) {
 		if (showing) {
@@ -446,13 +859,16 @@ void BrowserSource::SetShowing(bool showing)
 #endif
 
 		SendBrowserVisibility(cefBrowser, showing);
+		SetFrozen(!showing && freeze_on_invisible);
 
 		if (showing)
 			return;
 
 		obs_enter_graphics();
 
-		if (!hwaccel && texture) {
+		/* A frozen page isn't repainted when it is shown again, the
+		 * last frame is kept until it paints */
+		if (!hwaccel && texture && !freeze_on_invisible) {
 			DestroyTextures();
 		}
 
@@ -462,6 +878,11 @@ void BrowserSource::SetShowing(bool showing)
 
 void BrowserSource::SetActive(bool active)
 {
+	is_active = active;
+#if CHROME_VERSION_BUILD >= 4103
+	UpdateAudioSuspended();
+#endif
+
 	ExecuteOnBrowser(
 		[=](CefRefPtr<CefBrowser> cefBrowser) {
 			CefRefPtr<CefProcessMessage> msg =
@@ -477,6 +898,61 @@ void BrowserSource::SetActive(bool active)
 	DispatchJSEvent("obsSourceActiveChanged", json.dump(), this);
 }
 
+/* Freezes the page through the Page Lifecycle API while the source is
+ * hidden: timers, animation frames and loading tasks stop, but the page
+ * keeps its state and resumes where it was once the source is shown */
+void BrowserSource::SetFrozen(bool frozen)
+{
+	if (page_frozen.exchange(frozen) == frozen)
+		return;
+
+#if ENABLE_WASHIDDEN
+	ExecuteOnBrowser(
+		[=](CefRefPtr<CefBrowser> cefBrowser) {
+			CefRefPtr<CefDictionaryValue> params =
+				CefDictionaryValue::Create();
+			params->SetString("state",
+					  frozen ? "frozen" : "active");
+			cefBrowser->GetHost()->ExecuteDevToolsMethod(
+				0, "Page.setWebLifecycleState", params);
+		},
+		true);
+#endif
+}
+
+#if CHROME_VERSION_BUILD >= 4103
+/* Checked by the CEF audio thread for every packet, which drops audio
+ * while suspended rather than have libobs resample and mix it for nothing.
+ * The held audio is faded out here, as the next packet may be a while. */
+void BrowserSource::UpdateAudioSuspended()
+{
+	bool suspended;
+
+	switch (audio_suspend_mode) {
+	case AudioSuspendMode::Hidden:
+		suspended = !is_showing;
+		break;
+	case AudioSuspendMode::Inactive:
+		suspended = !is_active;
+		break;
+	default:
+		suspended = false;
+		break;
+	}
+
+	if (audio_suspended.exchange(suspended) == suspended)
+		return;
+
+	if (suspended)
+		audio_buffer.FadeOut(source);
+	else
+		audio_buffer.FadeIn();
+#if ENABLE_PAGE_AUDIO_STREAMS
+	FadePageAudio(suspended);
+#endif
+}
+#endif
+
 void BrowserSource::Refresh()
 {
 	ExecuteOnBrowser(
@@ -527,6 +1003,7 @@ void BrowserSource::Update(obs_data_t *settings)
 		bool n_shutdown;
 		bool n_restart;
 		bool n_reroute;
+		int n_audio_buffer_frames;
 		ControlLevel n_webpage_control_level;
 		std::string n_url;
 		std::string n_css;
@@ -538,14 +1015,27 @@ void BrowserSource::Update(obs_data_t *settings)
 		n_fps_custom = obs_data_get_bool(settings, "fps_custom");
 		n_fps = (int)obs_data_get_int(settings, "fps");
 		n_shutdown = obs_data_get_bool(settings, "shutdown");
+		freeze_on_invisible = obs_data_get_bool(settings, "freeze");
 		n_restart = obs_data_get_bool(settings, "restart_when_active");
 		n_css = obs_data_get_string(settings, "css");
 		n_url = obs_data_get_string(settings,
 					    n_is_local ? "local_file" : "url");
 		n_reroute = obs_data_get_bool(settings, "reroute_audio");
+		n_audio_buffer_frames =
+			(int)obs_data_get_int(settings, "audio_buffer_frames");
 		n_webpage_control_level = static_cast<ControlLevel>(
 			obs_data_get_int(settings, "webpage_control_level"));
 
+#if CHROME_VERSION_BUILD >= 4103
+		/* Applies to the running stream, no need to recreate */
+		audio_gate.SetHoldTime((uint32_t)obs_data_get_int(
+			settings, "audio_silence_hold"));
+
+		audio_suspend_mode = static_cast<AudioSuspendMode>(
+			obs_data_get_int(settings, "audio_suspend_mode"));
+		UpdateAudioSuspended();
+#endif
+
 		if (n_is_local && !n_url.empty()) {
 			n_url = CefURIEncode(n_url, false);
 
@@ -587,30 +1077,29 @@ void BrowserSource::Update(obs_data_t *settings)
 		}
 #endif
 
-		if (n_is_local == is_local && n_fps_custom == fps_custom &&
-		    n_fps == fps && n_shutdown == shutdown_on_invisible &&
-		    n_restart == restart && n_css == css && n_url == url &&
-		    n_reroute == reroute_audio &&
-		    n_webpage_control_level == webpage_control_level) {
-
-			if (n_width == width && n_height == height)
-				return;
+		/* Only settings that are fixed when the browser is created
+		 * need a new browser, the rest is applied to the running one */
+		/* The media stream flag is passed to the renderer process
+		 * when it is launched, and CEF only asks for the audio
+		 * handler when the browser is created, so turning reroute
+		 * on needs a new browser while turning it off does not */
+		bool recreate = first_update ||
+				n_is_media_flag != is_media_flag ||
+				(n_reroute && !reroute_audio) ||
+				n_audio_buffer_frames != audio_buffer_frames;
+#if ENABLE_LOCAL_FILE_URL_SCHEME && CHROME_VERSION_BUILD < 4430
+		recreate = recreate || n_is_local != is_local;
+#endif
+#if defined(ENABLE_BROWSER_SHARED_TEXTURE) && \
+	defined(BROWSER_EXTERNAL_BEGIN_FRAME_ENABLED)
+		recreate = recreate || n_fps_custom != fps_custom;
+#endif
 
-			width = n_width;
-			height = n_height;
-			ExecuteOnBrowser(
-				[=](CefRefPtr<CefBrowser> cefBrowser) {
-					const CefSize cefSize(width, height);
-					cefBrowser->GetHost()
-						->GetClient()
-						->GetDisplayHandler()
-						->OnAutoResize(cefBrowser,
-							       cefSize);
-					cefBrowser->GetHost()->WasResized();
-					cefBrowser->GetHost()->Invalidate(
-						PET_VIEW);
-				},
-				true);
+		if (!recreate) {
+			UpdateInPlace(n_is_local, n_is_media_flag, n_width,
+				      n_height, n_fps_custom, n_fps, n_shutdown,
+				      n_restart, n_reroute,
+				      n_webpage_control_level, n_url, n_css);
 			return;
 		}
 		is_media_flag = n_is_media_flag;
@@ -621,6 +1110,7 @@ void BrowserSource::Update(obs_data_t *settings)
 		fps_custom = n_fps_custom;
 		shutdown_on_invisible = n_shutdown;
 		reroute_audio = n_reroute;
+		audio_buffer_frames = n_audio_buffer_frames;
 		webpage_control_level = n_webpage_control_level;
 		restart = n_restart;
 		css = n_css;
@@ -633,17 +1123,274 @@ void BrowserSource::Update(obs_data_t *settings)
 	DestroyTextures();
 #if CHROME_VERSION_BUILD < 4103
 	ClearAudioStreams();
+#elif ENABLE_PAGE_AUDIO_STREAMS
+	QueueCEFTask([this]() { ClearPageAudioStreams(); });
 #endif
-	if (!shutdown_on_invisible || obs_source_showing(source))
+	if (!shutdown_on_invisible || obs_source_showing(source)) {
+		create_requested = os_gettime_ns();
 		create_browser = true;
+	}
 
 	first_update = false;
 }
 
+void BrowserSource::UpdateInPlace(bool n_is_local, bool n_is_media_flag,
+				  int n_width, int n_height, bool n_fps_custom,
+				  int n_fps, bool n_shutdown, bool n_restart,
+				  bool n_reroute,
+				  ControlLevel n_webpage_control_level,
+				  const std::string &n_url,
+				  const std::string &n_css)
+{
+	bool resized = n_width != width || n_height != height;
+	bool fps_changed = n_fps != fps || n_fps_custom != fps_custom;
+	bool reroute_changed = n_reroute != reroute_audio;
+	bool level_changed = n_webpage_control_level != webpage_control_level;
+	bool url_changed = n_url != url;
+	bool css_changed = n_css != css;
+	bool shutdown_changed = n_shutdown != shutdown_on_invisible;
+
+	is_media_flag = n_is_media_flag;
+	is_local = n_is_local;
+	width = n_width;
+	height = n_height;
+	fps = n_fps;
+	fps_custom = n_fps_custom;
+	shutdown_on_invisible = n_shutdown;
+	reroute_audio = n_reroute;
+	webpage_control_level = n_webpage_control_level;
+	restart = n_restart;
+	url = n_url;
+	css = n_css;
+
+	int frame_rate = fps;
+#ifdef ENABLE_BROWSER_SHARED_TEXTURE
+#ifdef BROWSER_EXTERNAL_BEGIN_FRAME_ENABLED
+	if (!fps_custom)
+		frame_rate = 0;
+#else
+	if (!fps_custom)
+		frame_rate = (int)canvas_fps;
+#endif
+#endif
+
+	/* Only ever turned off here, see Update */
+	if (reroute_changed) {
+		obs_source_set_audio_active(source, false);
+#if CHROME_VERSION_BUILD < 4103
+		ClearAudioStreams();
+#elif ENABLE_PAGE_AUDIO_STREAMS
+		QueueCEFTask([this]() { ClearPageAudioStreams(); });
+#endif
+	}
+
+	if (resized || (fps_changed && frame_rate) || reroute_changed ||
+	    level_changed || url_changed || css_changed) {
+		ExecuteOnBrowser(
+			[=](CefRefPtr<CefBrowser> cefBrowser) {
+				CefRefPtr<CefBrowserHost> host =
+					cefBrowser->GetHost();
+				CefRefPtr<CefClient> client = host->GetClient();
+				BrowserClient *bc = reinterpret_cast<
+					BrowserClient *>(client.get());
+
+				if (resized) {
+					const CefSize cefSize(n_width,
+							      n_height);
+					client->GetDisplayHandler()
+						->OnAutoResize(cefBrowser,
+							       cefSize);
+					host->WasResized();
+					host->Invalidate(PET_VIEW);
+				}
+				if (fps_changed && frame_rate)
+					host->SetWindowlessFrameRate(
+						frame_rate);
+				if (reroute_changed) {
+					bc->SetRerouteAudio(false);
+					host->SetAudioMuted(false);
+				}
+				if (level_changed) {
+					bc->SetControlLevel(
+						n_webpage_control_level);
+#if BROWSER_FRONTEND_API_SUPPORT_ENABLED
+					RestrictState(this, cefBrowser,
+						      n_webpage_control_level);
+#endif
+				}
+				if (css_changed)
+					SendBrowserCSS(cefBrowser, n_css);
+				if (url_changed)
+					cefBrowser->GetMainFrame()->LoadURL(
+						n_url);
+			},
+			true);
+	}
+
+	if (!shutdown_on_invisible)
+		SetFrozen(!is_showing && freeze_on_invisible);
+
+	if (shutdown_changed && !obs_source_showing(source)) {
+		if (shutdown_on_invisible) {
+			DestroyBrowser();
+		} else if (!GetBrowser() && !create_browser && !loading) {
+			create_requested = os_gettime_ns();
+			create_browser = true;
+		}
+	}
+}
+
+static void SendToBrowsers(std::vector<CefRefPtr<CefBrowser>> browsers,
+			   CefRefPtr<CefProcessMessage> msg);
+
+/* Lets pages advance animations exactly once per OBS frame.  Only sent
+ * while a page has set obsstudio.onVideoTick and the source is shown, as
+ * OBS won't render the frames of a hidden source anyway.  The first of
+ * those sources to tick in a frame sends it to all of them at once. */
+static void SendVideoTicks()
+{
+	static std::atomic<uint64_t> last_frame_time = 0;
+
+	uint64_t frame_time = obs_get_video_frame_time();
+	if (last_frame_time.exchange(frame_time) == frame_time)
+		return;
+
+	std::vector<CefRefPtr<CefBrowser>> browsers;
+	{
+		lock_guard<mutex> lock(browser_list_mutex);
+		for (BrowserSource *bs = first_browser; bs; bs = bs->next) {
+			if (!bs->video_tick || !bs->is_showing)
+				continue;
+
+			CefRefPtr<CefBrowser> cefBrowser = bs->GetBrowser();
+			if (!!cefBrowser)
+				browsers.push_back(cefBrowser);
+		}
+	}
+
+	if (browsers.empty())
+		return;
+
+	CefRefPtr<CefProcessMessage> msg =
+		CefProcessMessage::Create("VideoTick");
+	CefRefPtr<CefListValue> args = msg->GetArgumentList();
+	args->SetDouble(0, (double)frame_time / 1000000.0);
+	args->SetDouble(1, (double)GetVideoFrameIndex(frame_time));
+
+	SendToBrowsers(std::move(browsers), msg);
+}
+
+/* Browsers are created a few at a time, sources on program first, then
+ * shown ones, and hidden ones one by one in the background.  Otherwise
+ * loading a scene collection spawns every renderer process and starts
+ * every page load at once, and visible overlays wait behind hidden ones.
+ * A browser counts as loading until its main frame has loaded, or until it
+ * times out so a hanging page doesn't hold up the rest. */
+#define MAX_LOADING_BROWSERS 4
+#define MAX_LOADING_HIDDEN_BROWSERS 1
+#define LOADING_TIMEOUT_NS 10000000000ULL
+
+enum CreatePriority {
+	CREATE_ACTIVE,
+	CREATE_SHOWING,
+	CREATE_HIDDEN,
+};
+
+void ScheduleBrowserCreation()
+{
+	/* Sources stay queued until CEF has started */
+	if (os_event_try(cef_started_event) != 0)
+		return;
+
+	uint64_t now = os_gettime_ns();
+	std::vector<std::pair<CreatePriority, BrowserSource *>> pending;
+	size_t loading = 0;
+
+	lock_guard<mutex> lock(browser_list_mutex);
+	for (BrowserSource *bs = first_browser; bs; bs = bs->next) {
+		if (bs->destroying)
+			continue;
+
+		if (bs->loading) {
+			if (now - bs->create_scheduled < LOADING_TIMEOUT_NS) {
+				loading++;
+			} else {
+				bs->loading = false;
+				blog(LOG_WARNING,
+				     "[obs-browser]: '%s' still loading after "
+				     "%d ms, no longer waiting for it",
+				     obs_source_get_name(bs->source),
+				     (int)(LOADING_TIMEOUT_NS / 1000000ULL));
+			}
+		}
+
+		if (!bs->create_browser)
+			continue;
+
+		CreatePriority priority = CREATE_HIDDEN;
+		if (obs_source_active(bs->source))
+			priority = CREATE_ACTIVE;
+		else if (obs_source_showing(bs->source))
+			priority = CREATE_SHOWING;
+		pending.emplace_back(priority, bs);
+	}
+
+	std::stable_sort(pending.begin(), pending.end(),
+			 [](const auto &a, const auto &b) {
+				 return a.first < b.first;
+			 });
+
+	for (auto &[priority, bs] : pending) {
+		size_t limit = priority == CREATE_HIDDEN
+				       ? MAX_LOADING_HIDDEN_BROWSERS
+				       : MAX_LOADING_BROWSERS;
+		if (loading >= limit)
+			break;
+
+		bs->create_scheduled = now;
+		bs->loading = true;
+		if (!bs->CreateBrowser()) {
+			bs->loading = false;
+			break;
+		}
+
+		bs->create_browser = false;
+		loading++;
+	}
+
+	/* Top up the pool once nothing is waiting on the renderer */
+	if (!loading)
+		RefillBrowserPool();
+}
+
+void BrowserSource::FinishLoading(bool success)
+{
+	if (!loading.exchange(false))
+		return;
+
+	uint64_t now = os_gettime_ns();
+	blog(LOG_INFO,
+	     "[obs-browser]: '%s' %s: waited %d ms, created in %d ms, "
+	     "loaded in %d ms",
+	     source ? obs_source_get_name(source) : "",
+	     success ? "loaded" : "failed to load",
+	     (int)((create_scheduled - create_requested) / 1000000ULL),
+	     (int)((create_finished - create_scheduled) / 1000000ULL),
+	     (int)((now - create_finished) / 1000000ULL));
+}
+
 void BrowserSource::Tick()
 {
-	if (create_browser && CreateBrowser())
-		create_browser = false;
+	if (video_tick && is_showing)
+		SendVideoTicks();
+#if CHROME_VERSION_BUILD < 4103
+	PruneRetiredAudioSources();
+#else
+	audio_buffer.FlushIdle(source);
+#if ENABLE_PAGE_AUDIO_STREAMS
+	FlushIdlePageAudio();
+#endif
+#endif
 #if defined(ENABLE_BROWSER_SHARED_TEXTURE)
 #if defined(BROWSER_EXTERNAL_BEGIN_FRAME_ENABLED)
 	if (!fps_custom)
@@ -727,43 +1474,160 @@ void BrowserSource::Render()
 #endif
 }
 
-static void ExecuteOnBrowser(BrowserFunc func, BrowserSource *bs)
+/* Collects the CEF browsers that a broadcast should be delivered to, so that
+ * it only needs a single CEF task rather than one closure per source */
+static void GetEventTargets(std::vector<CefRefPtr<CefBrowser>> &browsers)
 {
 	lock_guard<mutex> lock(browser_list_mutex);
 
-	if (bs) {
-		BrowserSource *bsw = reinterpret_cast<BrowserSource *>(bs);
-		bsw->ExecuteOnBrowser(func, true);
+	for (BrowserSource *bs = first_browser; bs; bs = bs->next) {
+		CefRefPtr<CefBrowser> cefBrowser = bs->GetBrowser();
+		if (!!cefBrowser)
+			browsers.push_back(cefBrowser);
 	}
 }
 
-static void ExecuteOnAllBrowsers(BrowserFunc func)
+static void SendToBrowsers(std::vector<CefRefPtr<CefBrowser>> browsers,
+			   CefRefPtr<CefProcessMessage> msg)
 {
-	lock_guard<mutex> lock(browser_list_mutex);
+	if (browsers.empty())
+		return;
 
-	BrowserSource *bs = first_browser;
-	while (bs) {
-		BrowserSource *bsw = reinterpret_cast<BrowserSource *>(bs);
-		bsw->ExecuteOnBrowser(func, true);
-		bs = bs->next;
+	/* Sending a message hands it off, so every browser but the last one
+	 * receives a copy of the already built message */
+#ifdef ENABLE_BROWSER_QT_LOOP
+	CefRefPtr<CefBrowser> first = browsers[0];
+#endif
+	auto send = [browsers = std::move(browsers), msg]() {
+		const size_t count = browsers.size();
+		for (size_t i = 0; i < count; i++) {
+			CefRefPtr<CefProcessMessage> out =
+				i + 1 < count ? msg->Copy() : msg;
+			SendBrowserProcessMessage(browsers[i], PID_RENDERER,
+						  out);
+		}
+	};
+
+#ifdef ENABLE_BROWSER_QT_LOOP
+	/* A single browser task for all of them, queued with the first one so
+	 * that it stays in order with the tasks ExecuteOnBrowser queues */
+	QueueBrowserTask(first, [send](CefRefPtr<CefBrowser>) { send(); });
+#else
+	QueueCEFTask(send);
+#endif
+}
+
+/* An event for one source goes through ExecuteOnBrowser, which holds it
+ * until a browser that is still being created exists */
+static void SendEvent(BrowserSource *target,
+		      std::vector<CefRefPtr<CefBrowser>> browsers,
+		      CefRefPtr<CefProcessMessage> msg)
+{
+	if (!target) {
+		SendToBrowsers(std::move(browsers), msg);
+		return;
 	}
+
+	target->ExecuteOnBrowser(
+		[msg](CefRefPtr<CefBrowser> cefBrowser) {
+			SendBrowserProcessMessage(cefBrowser, PID_RENDERER,
+						  msg);
+		},
+		true);
 }
 
 void DispatchJSEvent(std::string eventName, std::string jsonString,
 		     BrowserSource *browser)
 {
-	const auto jsEvent = [=](CefRefPtr<CefBrowser> cefBrowser) {
-		CefRefPtr<CefProcessMessage> msg =
-			CefProcessMessage::Create("DispatchJSEvent");
-		CefRefPtr<CefListValue> args = msg->GetArgumentList();
+	std::vector<CefRefPtr<CefBrowser>> browsers;
+	if (!browser) {
+		GetEventTargets(browsers);
+		if (browsers.empty())
+			return;
+	}
 
-		args->SetString(0, eventName);
-		args->SetString(1, jsonString);
-		SendBrowserProcessMessage(cefBrowser, PID_RENDERER, msg);
-	};
+	CefRefPtr<CefProcessMessage> msg =
+		CefProcessMessage::Create("DispatchJSEvent");
+	CefRefPtr<CefListValue> args = msg->GetArgumentList();
 
-	if (!browser)
-		ExecuteOnAllBrowsers(jsEvent);
-	else
-		ExecuteOnBrowser(jsEvent, browser);
+	args->SetString(0, eventName);
+	args->SetString(1, jsonString);
+
+	SendEvent(browser, std::move(browsers), msg);
+}
+
+void DispatchJSEvents(
+	const std::vector<std::pair<std::string, std::string>> &events,
+	BrowserSource *browser)
+{
+	if (events.empty())
+		return;
+
+	std::vector<CefRefPtr<CefBrowser>> browsers;
+	if (!browser) {
+		GetEventTargets(browsers);
+		if (browsers.empty())
+			return;
+	}
+
+	/* Events are packed as name/data pairs and dispatched by the
+	 * renderer in the order they were given */
+	CefRefPtr<CefProcessMessage> msg =
+		CefProcessMessage::Create("DispatchJSEvents");
+	CefRefPtr<CefListValue> args = msg->GetArgumentList();
+
+	size_t idx = 0;
+	for (auto &event : events) {
+		args->SetString(idx++, event.first);
+		args->SetString(idx++, event.second);
+	}
+
+	SendEvent(browser, std::move(browsers), msg);
+}
+
+#if BROWSER_FRONTEND_API_SUPPORT_ENABLED
+uint32_t GetSubscribedStateTopics()
+{
+	uint32_t topics = 0;
+
+	lock_guard<mutex> lock(browser_list_mutex);
+	for (BrowserSource *bs = first_browser; bs; bs = bs->next)
+		topics |= bs->state_topics;
+	return topics;
+}
+
+void DispatchStateUpdate(const std::vector<StateValue> &values)
+{
+	std::vector<CefRefPtr<CefBrowser>> browsers;
+
+	{
+		lock_guard<mutex> lock(browser_list_mutex);
+
+		for (BrowserSource *bs = first_browser; bs; bs = bs->next) {
+			if (!bs->state_topics)
+				continue;
+
+			CefRefPtr<CefBrowser> cefBrowser = bs->GetBrowser();
+			if (cefBrowser)
+				browsers.push_back(cefBrowser);
+		}
+	}
+
+	if (browsers.empty())
+		return;
+
+	/* Filtered on the UI thread, where navigations reset the
+	 * subscriptions, so a value that was in flight while the page
+	 * navigated doesn't fill the new page's cache */
+	QueueCEFTask([browsers = std::move(browsers), values]() {
+		for (const CefRefPtr<CefBrowser> &browser : browsers) {
+			CefRefPtr<CefClient> client =
+				browser->GetHost()->GetClient();
+			BrowserClient *bc =
+				reinterpret_cast<BrowserClient *>(client.get());
+			if (bc && bc->bs)
+				SendStateUpdate(bc->bs, browser, values);
+		}
+	});
 }
+#endif
@@ -26,9 +26,11 @@
 #include <functional>
 #include <string>
 #include <mutex>
+#include <vector>
 
 #if CHROME_VERSION_BUILD < 4103
 #include <obs.hpp>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
@@ -38,6 +40,35 @@ struct AudioStream {
 	int channels;
 	int sample_rate;
 };
+
+typedef std::vector<obs_source_t *> AudioSourceList;
+
+/* Sources of streams that stopped, kept alive until the audio thread no
+ * longer holds the list it might still be mixing them from */
+struct RetiredAudioSources {
+	std::shared_ptr<const AudioSourceList> list;
+	std::vector<OBSSourceAutoRelease> sources;
+};
+#else
+#include "browser-audio-buffer.hpp"
+#include "browser-audio-remix.hpp"
+
+#if ENABLE_PAGE_AUDIO_STREAMS
+#include <obs.hpp>
+#include <map>
+#include <memory>
+
+#define MAX_PAGE_AUDIO_STREAMS 8
+
+/* Audio a page sends with obsstudio.outputAudio, output to its own private
+ * child source so it can be routed apart from the page's main audio */
+struct PageAudioStream {
+	OBSSourceAutoRelease source;
+	AudioJitterBuffer buffer;
+	size_t channels = 0;
+	uint32_t sample_rate = 0;
+};
+#endif
 #endif
 
 enum class ControlLevel : int {
@@ -50,8 +81,17 @@ enum class ControlLevel : int {
 };
 inline constexpr ControlLevel DEFAULT_CONTROL_LEVEL = ControlLevel::ReadObs;
 
+/* When page audio stops being output */
+enum class AudioSuspendMode : int {
+	Never,
+	Hidden,
+	Inactive,
+};
+
 extern bool hwaccel;
 
+class BrowserClient;
+
 struct BrowserSource {
 	BrowserSource **p_prev_next = nullptr;
 	BrowserSource *next = nullptr;
@@ -60,8 +100,18 @@ struct BrowserSource {
 
 	bool tex_sharing_avail = false;
 	bool create_browser = false;
+	/* Creation timeline, see ScheduleBrowserCreation */
+	std::atomic<bool> loading = false;
+	uint64_t create_requested = 0;
+	uint64_t create_scheduled = 0;
+	uint64_t create_finished = 0;
 	std::recursive_mutex lockBrowser;
 	CefRefPtr<CefBrowser> cefBrowser;
+	CefRefPtr<BrowserClient> pending_client;
+	std::vector<BrowserFunc> pending_tasks;
+	/* Clients let go of while pending, whose bs the destructor clears in
+	 * case it runs before the task DestroyBrowser queued to do so */
+	std::vector<CefRefPtr<BrowserClient>> dropped_clients;
 
 	std::string url;
 	std::string css;
@@ -86,17 +136,32 @@ struct BrowserSource {
 	double canvas_fps = 0;
 	bool restart = false;
 	bool shutdown_on_invisible = false;
+	bool freeze_on_invisible = false;
+	/* Set from the OBS threads and from OnBrowserCreated on the CEF UI
+	 * thread */
+	std::atomic<bool> page_frozen = false;
 	bool is_local = false;
 	bool is_media_flag = false;
 	bool first_update = true;
 	bool reroute_audio = true;
+	int audio_buffer_frames = 1024;
 	std::atomic<bool> destroying = false;
 	ControlLevel webpage_control_level = DEFAULT_CONTROL_LEVEL;
+	std::atomic<uint32_t> state_topics = 0;
+	/* Topic JSON last pushed to the page, only used on the CEF UI
+	 * thread, see SendStateUpdate */
+	std::vector<std::string> state_sent;
+	std::atomic<bool> video_tick = false;
 #if defined(BROWSER_EXTERNAL_BEGIN_FRAME_ENABLED) && \
 	defined(ENABLE_BROWSER_SHARED_TEXTURE)
 	bool reset_frame = false;
 #endif
-	bool is_showing = false;
+	std::atomic<bool> is_showing = false;
+	bool is_active = false;
+#if CHROME_VERSION_BUILD >= 4103
+	AudioSuspendMode audio_suspend_mode = AudioSuspendMode::Never;
+	std::atomic<bool> audio_suspended = false;
+#endif
 
 	inline void DestroyTextures()
 	{
@@ -136,9 +201,35 @@ struct BrowserSource {
 	void EnumAudioStreams(obs_source_enum_proc_t cb, void *param);
 	bool AudioMix(uint64_t *ts_out, struct audio_output_data *audio_output,
 		      size_t channels, size_t sample_rate);
-	std::mutex audio_sources_mutex;
-	std::vector<obs_source_t *> audio_sources;
+	void
+	PublishAudioSources(std::shared_ptr<const AudioSourceList> list,
+			    std::vector<OBSSourceAutoRelease> removed = {});
+	std::shared_ptr<const AudioSourceList> GetAudioSources();
+	void PruneRetiredAudioSources();
+	/* Only replaced on the CEF thread, with std::atomic_exchange, and
+	 * read with std::atomic_load, so the audio thread never waits on a
+	 * lock that the CEF thread holds.  Retired lists are pruned on the
+	 * CEF thread and from Tick. */
+	std::shared_ptr<const AudioSourceList> audio_sources;
+	std::mutex retired_audio_sources_mutex;
+	std::vector<RetiredAudioSources> retired_audio_sources;
 	std::unordered_map<int, AudioStream> audio_streams;
+#else
+	AudioRemixer audio_remix;
+	AudioJitterBuffer audio_buffer;
+	AudioSilenceGate audio_gate;
+#if ENABLE_PAGE_AUDIO_STREAMS
+	void OutputPageAudio(const std::string &name, uint32_t sample_rate,
+			     const float **data, size_t channels,
+			     size_t frames, uint64_t delay);
+	void FlushIdlePageAudio();
+	void FadePageAudio(bool suspended);
+	void ClearPageAudioStreams();
+	std::mutex page_audio_mutex;
+	std::map<std::string, std::unique_ptr<PageAudioStream>>
+		page_audio_streams;
+	bool page_audio_limit_warned = false;
+#endif
 #endif
 	void SendMouseClick(const struct obs_mouse_event *event, int32_t type,
 			    bool mouse_up, uint32_t click_count);
@@ -150,6 +241,9 @@ struct BrowserSource {
 	void SendKeyClick(const struct obs_key_event *event, bool key_up);
 	void SetShowing(bool showing);
 	void SetActive(bool active);
+#if CHROME_VERSION_BUILD >= 4103
+	void UpdateAudioSuspended();
+#endif
 	void Refresh();
 
 #if defined(BROWSER_EXTERNAL_BEGIN_FRAME_ENABLED) && \
@@ -159,4 +253,25 @@ struct BrowserSource {
 
 	void SetBrowser(CefRefPtr<CefBrowser> b);
 	CefRefPtr<CefBrowser> GetBrowser();
+	void FinishLoading(bool success);
+	void OnBrowserCreated(CefRefPtr<BrowserClient> client,
+			      CefRefPtr<CefBrowser> browser);
+	void SetFrozen(bool frozen);
+	void UpdateInPlace(bool n_is_local, bool n_is_media_flag, int n_width,
+			   int n_height, bool n_fps_custom, int n_fps,
+			   bool n_shutdown, bool n_restart, bool n_reroute,
+			   ControlLevel n_webpage_control_level,
+			   const std::string &n_url, const std::string &n_css);
 };
+
+void SendBrowserCSS(CefRefPtr<CefBrowser> browser, const std::string &css);
+void DeleteRetiredBrowsers();
+void BrowserOpened();
+void BrowserClosed();
+bool WaitForBrowsersClosed(uint32_t timeout_ms);
+void ScheduleBrowserCreation();
+void SetBrowserPoolSize(size_t size);
+void RefillBrowserPool();
+void ClearBrowserPool();
+void AddPooledBrowser(CefRefPtr<CefBrowser> browser,
+		      CefRefPtr<BrowserClient> client);
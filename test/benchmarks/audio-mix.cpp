@@ -0,0 +1,161 @@
+/******************************************************************************
+ Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/* Time spent on the audio thread to mix a browser with 8 streams, as done
+ * by BrowserSource::AudioMix on CEF builds older than 4103.
+ *
+ * Each mix takes the current stream list and adds every stream onto the
+ * output, while a second thread keeps replacing the list the way streams
+ * starting and stopping do.  The list is published once through
+ * std::atomic_load/std::atomic_exchange and once behind a mutex.
+ *
+ *   obs-browser-bench-audio-mix [mixes]
+ */
+
+#include "browser-audio-mix.hpp"
+#include <media-io/audio-io.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define STREAMS 8
+#define CHANNELS 2
+
+struct Stream {
+	std::vector<float> planes[CHANNELS];
+	/* First frame of the tick, from the stream's timestamp */
+	size_t pos = 0;
+};
+
+typedef std::vector<const Stream *> StreamList;
+
+struct AtomicList {
+	std::shared_ptr<const StreamList> list;
+
+	std::shared_ptr<const StreamList> Get()
+	{
+		return std::atomic_load(&list);
+	}
+	void Publish(std::shared_ptr<const StreamList> next)
+	{
+		std::atomic_exchange(&list, std::move(next));
+	}
+};
+
+struct LockedList {
+	std::mutex mutex;
+	std::shared_ptr<const StreamList> list;
+
+	std::shared_ptr<const StreamList> Get()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return list;
+	}
+	void Publish(std::shared_ptr<const StreamList> next)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		list.swap(next);
+	}
+};
+
+static double Percentile(const std::vector<double> &sorted, double p)
+{
+	size_t idx = (size_t)((double)sorted.size() * p);
+	return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+template<typename List>
+static void Run(const char *name, const std::vector<Stream> &streams,
+		size_t mixes)
+{
+	List list;
+	std::atomic<bool> stop = false;
+	size_t published = 0;
+
+	/* Alternates between all streams and all but the last one */
+	auto publish = [&](size_t count) {
+		auto next = std::make_shared<StreamList>();
+		for (size_t i = 0; i < count; i++)
+			next->push_back(&streams[i]);
+		list.Publish(std::move(next));
+	};
+	publish(STREAMS);
+
+	std::thread publisher([&]() {
+		while (!stop)
+			publish(published++ % 2 ? STREAMS : STREAMS - 1);
+	});
+
+	static float out[CHANNELS][AUDIO_OUTPUT_FRAMES];
+	std::vector<double> samples;
+	samples.reserve(mixes);
+
+	for (size_t i = 0; i < mixes; i++) {
+		memset(out, 0, sizeof(out));
+
+		auto start = std::chrono::steady_clock::now();
+		std::shared_ptr<const StreamList> sources = list.Get();
+		for (const Stream *stream : *sources) {
+			size_t count = AUDIO_OUTPUT_FRAMES - stream->pos;
+			for (size_t ch = 0; ch < CHANNELS; ch++)
+				mix_audio(out[ch], stream->planes[ch].data(),
+					  stream->pos, count);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		samples.push_back(
+			std::chrono::duration<double, std::micro>(end - start)
+				.count());
+	}
+
+	stop = true;
+	publisher.join();
+
+	std::sort(samples.begin(), samples.end());
+	printf("%-8s p50 %7.2f us  p99 %7.2f us  max %8.2f us  "
+	       "(%zu lists published, out %f)\n",
+	       name, Percentile(samples, 0.5), Percentile(samples, 0.99),
+	       samples.back(), published, out[0][0]);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t mixes = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+	if (!mixes)
+		mixes = 1;
+
+	std::vector<Stream> streams(STREAMS);
+	for (size_t i = 0; i < STREAMS; i++) {
+		for (size_t ch = 0; ch < CHANNELS; ch++)
+			streams[i].planes[ch].assign(AUDIO_OUTPUT_FRAMES,
+						     0.01f * (float)(i + 1));
+	}
+
+	printf("%d streams, %d channels, %d frames, %zu mixes\n", STREAMS,
+	       CHANNELS, AUDIO_OUTPUT_FRAMES, mixes);
+
+	Run<AtomicList>("atomic", streams, mixes);
+	Run<LockedList>("mutex", streams, mixes);
+	return 0;
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/* Time AudioRemixer::Process takes per packet for the layouts that have to
+ * be remixed, at the packet sizes CEF commonly delivers.
+ *
+ *   obs-browser-bench-audio-remix [packets]
+ */
+
+#include "browser-audio-remix.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+struct Case {
+	cef_channel_layout_t layout;
+	int channels;
+	speaker_layout speakers;
+	const char *name;
+};
+
+static const Case cases[] = {
+	{CEF_CHANNEL_LAYOUT_5_0, 5, SPEAKERS_STEREO, "5.0 -> stereo"},
+	{CEF_CHANNEL_LAYOUT_7_1_WIDE, 8, SPEAKERS_STEREO, "7.1 wide -> stereo"},
+	{CEF_CHANNEL_LAYOUT_OCTAGONAL, 8, SPEAKERS_STEREO,
+	 "octagonal -> stereo"},
+	{CEF_CHANNEL_LAYOUT_OCTAGONAL, 8, SPEAKERS_5POINT1,
+	 "octagonal -> 5.1"},
+};
+
+int main(int argc, char *argv[])
+{
+	size_t packets = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+	if (!packets)
+		packets = 1;
+
+	static const size_t frame_counts[] = {441, 480, 1024};
+
+	std::vector<float> input[MAX_AV_PLANES];
+	const float *data[MAX_AV_PLANES];
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		input[i].assign(1024, 0.01f * (float)(i + 1));
+		data[i] = input[i].data();
+	}
+
+	float sink = 0.0f;
+
+	for (const Case &c : cases) {
+		for (size_t frames : frame_counts) {
+			AudioRemixer remix;
+			remix.Configure(c.layout, c.channels, frames,
+					c.speakers);
+
+			auto start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < packets; i++)
+				sink += remix.Process(data, frames)[0][i % 4];
+			auto end = std::chrono::steady_clock::now();
+
+			double ns = std::chrono::duration<double, std::nano>(
+					    end - start)
+					    .count() /
+				    (double)packets;
+			printf("%-20s %4zu frames  %8.1f ns/packet  "
+			       "%6.2f ns/frame\n",
+			       c.name, frames, ns, ns / (double)frames);
+		}
+	}
+
+	printf("(sink %f)\n", sink);
+	return 0;
+}
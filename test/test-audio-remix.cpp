@@ -0,0 +1,324 @@
+/******************************************************************************
+ Copyright (C) 2024 by Streamlabs (General Workings Inc)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/* Checks AudioRemixer against the ITU-R BS.775 downmix of every CEF channel
+ * layout onto the OBS mono, stereo, 5.1 and 7.1 layouts.  Each input plane
+ * holds its own signal, so every output sample has to be the weighted sum
+ * of exactly the inputs the standard folds into that speaker.  Frame counts
+ * that aren't a multiple of 4 cover the scalar tail of the SSE loops. */
+
+#include "browser-audio-remix.hpp"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#define C3DB 0.70710678f /* -3 dB */
+#define C6DB 0.5f        /* -6 dB */
+
+/* KM is the keyboard mic, which has no speaker to go to */
+enum Ch { L, R, C, LFE, BL, BR, LC, RC, BC, SL, SR, KM, CH_COUNT };
+
+static const char *ch_names[CH_COUNT] = {"L",  "R",  "C",  "LFE",
+					 "BL", "BR", "LC", "RC",
+					 "BC", "SL", "SR", "KM"};
+
+struct CefLayout {
+	cef_channel_layout_t layout;
+	const char *name;
+	std::vector<Ch> planes;
+	bool exact;
+};
+
+/* Plane order as Chromium delivers it, see media/base/channel_layout.cc */
+static const CefLayout cef_layouts[] = {
+	{CEF_CHANNEL_LAYOUT_MONO, "mono", {C}, true},
+	{CEF_CHANNEL_LAYOUT_STEREO, "stereo", {L, R}, true},
+	{CEF_CHANNEL_LAYOUT_STEREO_DOWNMIX, "stereo downmix", {L, R}, true},
+	{CEF_CHANNEL_LAYOUT_STEREO_AND_KEYBOARD_MIC,
+	 "stereo and keyboard mic",
+	 {L, R, KM},
+	 false},
+	{CEF_CHANNEL_LAYOUT_2POINT1, "2.1 (LFE)", {L, R, LFE}, true},
+	{CEF_CHANNEL_LAYOUT_2_1, "2_1", {L, R, BC}, false},
+	{CEF_CHANNEL_LAYOUT_SURROUND, "surround", {L, R, C}, false},
+	{CEF_CHANNEL_LAYOUT_3_1, "3.1", {L, R, C, LFE}, false},
+	{CEF_CHANNEL_LAYOUT_4_0, "4.0", {L, R, C, BC}, true},
+	{CEF_CHANNEL_LAYOUT_2_2, "2_2", {L, R, SL, SR}, false},
+	{CEF_CHANNEL_LAYOUT_QUAD, "quad", {L, R, BL, BR}, false},
+	{CEF_CHANNEL_LAYOUT_4_1, "4.1", {L, R, C, LFE, BC}, true},
+	{CEF_CHANNEL_LAYOUT_4_1_QUAD_SIDE,
+	 "4.1 quad side",
+	 {L, R, SL, SR, LFE},
+	 false},
+	{CEF_CHANNEL_LAYOUT_5_0, "5.0", {L, R, C, SL, SR}, false},
+	{CEF_CHANNEL_LAYOUT_5_0_BACK, "5.0 back", {L, R, C, BL, BR}, false},
+	{CEF_CHANNEL_LAYOUT_5_1, "5.1", {L, R, C, LFE, SL, SR}, true},
+	{CEF_CHANNEL_LAYOUT_5_1_BACK,
+	 "5.1 back",
+	 {L, R, C, LFE, BL, BR},
+	 true},
+	{CEF_CHANNEL_LAYOUT_6_0, "6.0", {L, R, C, SL, SR, BC}, false},
+	{CEF_CHANNEL_LAYOUT_6_0_FRONT,
+	 "6.0 front",
+	 {L, R, SL, SR, LC, RC},
+	 false},
+	{CEF_CHANNEL_LAYOUT_HEXAGONAL,
+	 "hexagonal",
+	 {L, R, C, BL, BR, BC},
+	 false},
+	{CEF_CHANNEL_LAYOUT_6_1, "6.1", {L, R, C, LFE, SL, SR, BC}, false},
+	{CEF_CHANNEL_LAYOUT_6_1_BACK,
+	 "6.1 back",
+	 {L, R, C, LFE, BL, BR, BC},
+	 false},
+	{CEF_CHANNEL_LAYOUT_6_1_FRONT,
+	 "6.1 front",
+	 {L, R, SL, SR, LC, RC, LFE},
+	 false},
+	{CEF_CHANNEL_LAYOUT_7_0, "7.0", {L, R, C, SL, SR, BL, BR}, false},
+	{CEF_CHANNEL_LAYOUT_7_0_FRONT,
+	 "7.0 front",
+	 {L, R, C, SL, SR, LC, RC},
+	 false},
+	{CEF_CHANNEL_LAYOUT_7_1,
+	 "7.1",
+	 {L, R, C, LFE, BL, BR, SL, SR},
+	 true},
+	{CEF_CHANNEL_LAYOUT_7_1_WIDE,
+	 "7.1 wide",
+	 {L, R, C, LFE, SL, SR, LC, RC},
+	 false},
+	{CEF_CHANNEL_LAYOUT_7_1_WIDE_BACK,
+	 "7.1 wide back",
+	 {L, R, C, LFE, BL, BR, LC, RC},
+	 false},
+	{CEF_CHANNEL_LAYOUT_OCTAGONAL,
+	 "octagonal",
+	 {L, R, C, SL, SR, BL, BR, BC},
+	 false},
+};
+
+struct Contribution {
+	Ch out;
+	float coefficient;
+};
+
+struct OutLayout {
+	speaker_layout speakers;
+	const char *name;
+	std::vector<Ch> planes;
+	/* Where each input channel goes when the layout lacks it.  LFE is
+	 * dropped, as BS.775 leaves it out of every downmix, and so is KM. */
+	std::vector<Contribution> downmix[CH_COUNT];
+};
+
+static const OutLayout out_layouts[] = {
+	{SPEAKERS_MONO,
+	 "mono",
+	 {C},
+	 {
+		 /* L */ {{C, C3DB}},
+		 /* R */ {{C, C3DB}},
+		 /* C */ {{C, 1.0f}},
+		 /* LFE */ {},
+		 /* BL */ {{C, C6DB}},
+		 /* BR */ {{C, C6DB}},
+		 /* LC */ {{C, C3DB}},
+		 /* RC */ {{C, C3DB}},
+		 /* BC */ {{C, C6DB}},
+		 /* SL */ {{C, C6DB}},
+		 /* SR */ {{C, C6DB}},
+	 }},
+	{SPEAKERS_STEREO,
+	 "stereo",
+	 {L, R},
+	 {
+		 /* L */ {{L, 1.0f}},
+		 /* R */ {{R, 1.0f}},
+		 /* C */ {{L, C3DB}, {R, C3DB}},
+		 /* LFE */ {},
+		 /* BL */ {{L, C3DB}},
+		 /* BR */ {{R, C3DB}},
+		 /* LC */ {{L, 1.0f}},
+		 /* RC */ {{R, 1.0f}},
+		 /* BC */ {{L, C6DB}, {R, C6DB}},
+		 /* SL */ {{L, C3DB}},
+		 /* SR */ {{R, C3DB}},
+	 }},
+	{SPEAKERS_5POINT1,
+	 "5.1",
+	 {L, R, C, LFE, BL, BR},
+	 {
+		 /* L */ {{L, 1.0f}},
+		 /* R */ {{R, 1.0f}},
+		 /* C */ {{C, 1.0f}},
+		 /* LFE */ {{LFE, 1.0f}},
+		 /* BL */ {{BL, 1.0f}},
+		 /* BR */ {{BR, 1.0f}},
+		 /* LC */ {{L, C3DB}, {C, C3DB}},
+		 /* RC */ {{R, C3DB}, {C, C3DB}},
+		 /* BC */ {{BL, C3DB}, {BR, C3DB}},
+		 /* SL */ {{BL, 1.0f}},
+		 /* SR */ {{BR, 1.0f}},
+	 }},
+	{SPEAKERS_7POINT1,
+	 "7.1",
+	 {L, R, C, LFE, BL, BR, SL, SR},
+	 {
+		 /* L */ {{L, 1.0f}},
+		 /* R */ {{R, 1.0f}},
+		 /* C */ {{C, 1.0f}},
+		 /* LFE */ {{LFE, 1.0f}},
+		 /* BL */ {{BL, 1.0f}},
+		 /* BR */ {{BR, 1.0f}},
+		 /* LC */ {{L, C3DB}, {C, C3DB}},
+		 /* RC */ {{R, C3DB}, {C, C3DB}},
+		 /* BC */ {{BL, C3DB}, {BR, C3DB}},
+		 /* SL */ {{SL, 1.0f}},
+		 /* SR */ {{SR, 1.0f}},
+	 }},
+};
+
+static int failures = 0;
+
+/* A different signal per plane, so a wrong routing can't cancel out */
+static float Sample(size_t plane, size_t frame)
+{
+	return (float)(plane + 1) * 0.1f + (float)(frame % 7) * 0.01f;
+}
+
+/* Configured for one packet size and fed another, as CEF may do */
+static void CheckLayout(const CefLayout &in, const OutLayout &out,
+			size_t configured, size_t frames)
+{
+	const size_t in_channels = in.planes.size();
+
+	std::vector<std::vector<float>> input(in_channels);
+	std::vector<const float *> data(in_channels);
+	for (size_t i = 0; i < in_channels; i++) {
+		input[i].resize(frames);
+		for (size_t f = 0; f < frames; f++)
+			input[i][f] = Sample(i, f);
+		data[i] = input[i].data();
+	}
+
+	AudioRemixer remix;
+	speaker_layout speakers = remix.Configure(
+		in.layout, (int)in_channels, configured, out.speakers);
+	const float **result = remix.Process(data.data(), frames);
+
+	if (in.exact) {
+		if (!remix.Passthrough() || result != data.data() ||
+		    get_audio_channels(speakers) != in_channels) {
+			printf("FAIL %s -> %s: not passed through\n", in.name,
+			       out.name);
+			failures++;
+		}
+		return;
+	}
+
+	if (remix.Passthrough() || speakers != out.speakers ||
+	    remix.Channels() != out.planes.size()) {
+		printf("FAIL %s -> %s: not remixed onto %s\n", in.name,
+		       out.name, out.name);
+		failures++;
+		return;
+	}
+
+	for (size_t o = 0; o < out.planes.size(); o++) {
+		float coefficients[MAX_AV_PLANES] = {};
+		for (size_t i = 0; i < in_channels; i++) {
+			Ch ch = in.planes[i];
+			for (const Contribution &c : out.downmix[ch]) {
+				if (c.out == out.planes[o])
+					coefficients[i] += c.coefficient;
+			}
+		}
+
+		for (size_t f = 0; f < frames; f++) {
+			float expected = 0.0f;
+			for (size_t i = 0; i < in_channels; i++)
+				expected += coefficients[i] * input[i][f];
+
+			if (std::fabs(result[o][f] - expected) > 1e-5f) {
+				printf("FAIL %s -> %s (%zu frames): %s at "
+				       "frame %zu is %f, expected %f\n",
+				       in.name, out.name, frames,
+				       ch_names[out.planes[o]], f,
+				       result[o][f], expected);
+				failures++;
+				break;
+			}
+		}
+	}
+}
+
+/* Layouts without positions keep their planes in order */
+static void CheckDiscrete(size_t frames)
+{
+	const size_t in_channels = 3;
+
+	std::vector<std::vector<float>> input(in_channels);
+	std::vector<const float *> data(in_channels);
+	for (size_t i = 0; i < in_channels; i++) {
+		input[i].resize(frames);
+		for (size_t f = 0; f < frames; f++)
+			input[i][f] = Sample(i, f);
+		data[i] = input[i].data();
+	}
+
+	AudioRemixer remix;
+	remix.Configure(CEF_CHANNEL_LAYOUT_DISCRETE, (int)in_channels, frames,
+			SPEAKERS_STEREO);
+	const float **result = remix.Process(data.data(), frames);
+
+	for (size_t o = 0; o < 2; o++) {
+		for (size_t f = 0; f < frames; f++) {
+			if (result[o][f] != input[o][f]) {
+				printf("FAIL discrete -> stereo: plane %zu "
+				       "at frame %zu\n",
+				       o, f);
+				failures++;
+				break;
+			}
+		}
+	}
+}
+
+int main()
+{
+	/* A full SSE run with a tail, only a tail, and a packet larger than
+	 * the one the remixer was configured for */
+	static const size_t frame_counts[][2] = {
+		{1027, 1027}, {3, 3}, {480, 1027}};
+
+	for (auto &counts : frame_counts) {
+		for (const CefLayout &in : cef_layouts) {
+			for (const OutLayout &out : out_layouts)
+				CheckLayout(in, out, counts[0], counts[1]);
+		}
+		CheckDiscrete(counts[1]);
+	}
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+
+	printf("All layouts remixed as expected\n");
+	return 0;
+}